@@ -55,8 +55,37 @@ public:
     }
     
     bool IsFilterFile(const std::string &u8path) {
+        return DoFilterFile(u8path, [&u8path]() { return IsHidden(u8path); }, [&u8path]() {
+            return util::file::getFileSize(u8path);
+        });
+    }
+
+#ifdef __linux__
+    /**
+     * entry为reader刚读出的目录项，u8path为其完整路径
+     * 隐藏文件和文件类型直接用目录项中的信息判断，只有设置了文件尺寸过滤并且前面的条件都通过时
+     * 才通过reader做一次只取STATX_SIZE的statx，结果留在entry中供调用方继续使用
+     */
+    bool IsFilterFile(const std::string &u8path, DirReader &reader, DirEntry &entry) {
+        return DoFilterFile(u8path, [&entry]() { return entry.IsHidden(); }, [&reader, &entry]() -> uint64_t {
+            if (!reader.Stat(entry, STATX_SIZE))
+                return 0;
+            return entry.size;
+        });
+    }
+#endif
+
+    // 是否设置了文件尺寸过滤，设置时IsFilterFile需要取文件大小
+    bool IsFilterSize() const {
+        return 0 != file_size_min_ || 0 != file_size_max_;
+    }
+
+private:
+    // is_hidden与get_size都只在需要时调用，未开启隐藏文件过滤时不查询文件属性
+    template<typename IsHiddenF, typename GetSizeF>
+    bool DoFilterFile(const std::string &u8path, IsHiddenF &&is_hidden, GetSizeF &&get_size) {
         // 过滤隐藏文件
-        if (is_filter_hidden_ && IsHidden(u8path))
+        if (is_filter_hidden_ && is_hidden())
             return true;
     
         // 过滤文件路径
@@ -74,9 +103,9 @@ public:
             return true;
         
         // 过滤文件大小
-        if (0 == file_size_min_ && 0 == file_size_max_)
+        if (!IsFilterSize())
             return false;
-        uint64_t fz = util::file::getFileSize(u8path);
+        uint64_t fz = get_size();
         // 大小为 0 则不做限制
         if ((0 != file_size_min_ && fz < file_size_min_)
             || 0 != file_size_max_ && fz > file_size_max_)
@@ -85,7 +114,6 @@ public:
         return false;
     }
 
-private:
     unsigned int file_size_min_;
     unsigned int file_size_max_;
     std::vector<std::string> exclude_paths_;
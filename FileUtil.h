@@ -2,6 +2,7 @@
 #define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
 
 #include <fstream>
+#include <memory>
 #include <string>
 #ifdef _WIN32
 #include <windows.h>
@@ -11,6 +12,13 @@ namespace fs = std::experimental::filesystem;
 #include "filesystem.hpp"
 namespace fs = ghc::filesystem;
 #endif
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 namespace util {
 namespace file {
@@ -61,7 +69,13 @@ inline bool CheckIsDir(const fs::path &file_path) {
 }
 
 inline bool CheckIsDir(const std::string &file_path) {
+#ifdef __linux__
+    // Linux下utf8路径就是本地路径，直接stat，不构造fs::path
+    struct stat st;
+    return 0 == ::stat(file_path.c_str(), &st) && S_ISDIR(st.st_mode);
+#else
     return fs::is_directory(fs::u8path(file_path));
+#endif
 }
 
 inline bool CheckIsFile(const fs::path &file_path) {
@@ -69,7 +83,12 @@ inline bool CheckIsFile(const fs::path &file_path) {
 }
 
 inline bool CheckIsFile(const std::string &file_path) {
+#ifdef __linux__
+    struct stat st;
+    return 0 == ::stat(file_path.c_str(), &st) && S_ISREG(st.st_mode);
+#else
     return fs::is_regular_file(fs::u8path(file_path));
+#endif
 }
 
 inline std::fstream OpenFileUtf8(const std::string &file_path, std::ios_base::openmode mode = std::ios::in | std::ios::out) {
@@ -140,6 +159,12 @@ inline uint64_t getFileSize(std::ifstream& fs) {
 }
 
 inline uint64_t getFileSize(const std::string &file_path) {
+#ifdef __linux__
+    struct stat st;
+    if (0 != ::stat(file_path.c_str(), &st) || S_ISDIR(st.st_mode))
+        return 0;
+    return static_cast<uint64_t>(st.st_size);
+#else
     fs::path p = fs::u8path(file_path);
     try {
         if (!IsLongPath(file_path))
@@ -161,6 +186,7 @@ inline uint64_t getFileSize(const std::string &file_path) {
     catch (...) {
         return 0;
     }
+#endif
 }
 
 inline std::string GetExtension(const std::string &file_path) {
@@ -170,9 +196,16 @@ inline std::string GetExtension(const std::string &file_path) {
     return file_path.substr(dot_pos);
 }
 
+// 只看文件名判断是否隐藏，不访问文件系统
+inline bool IsHiddenName(const char *name) {
+    return name[0] == '.'
+           && name[1] != '\0'
+           && !(name[1] == '.' && name[2] == '\0');
+}
+
 inline bool IsHidden(const std::string &file_path) {
-    fs::path p = fs::u8path(file_path);
 #ifdef _WIN32
+    fs::path p = fs::u8path(file_path);
     DWORD attr = 0;
     if (IsLongPath(file_path))
         attr = GetFileAttributesW((L"\\\\?\\" + p.wstring()).c_str());
@@ -181,7 +214,11 @@ inline bool IsHidden(const std::string &file_path) {
     if (attr == INVALID_FILE_ATTRIBUTES)
         return false;
     return attr & FILE_ATTRIBUTE_HIDDEN;
+#elif defined(__linux__)
+    std::string::size_type sep_pos = file_path.find_last_of('/');
+    return IsHiddenName(file_path.c_str() + (std::string::npos == sep_pos ? 0 : sep_pos + 1));
 #else
+    fs::path p = fs::u8path(file_path);
     std::string filename = p.filename().string();
     return (filename != ".." &&
             filename != "." &&
@@ -189,5 +226,141 @@ inline bool IsHidden(const std::string &file_path) {
 #endif
 }
 
+#ifdef __linux__
+
+/**
+ * 目录项，type来自getdents64的d_type，size和mtime只有调用DirReader::Stat之后才有效
+ * stat_mask记录已经取到的字段(STATX_SIZE/STATX_MTIME)
+ */
+struct DirEntry {
+    std::string name;
+    fs::file_type type = fs::file_type::unknown;
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+    unsigned int stat_mask = 0;
+
+    bool IsDir() const { return type == fs::file_type::directory; }
+
+    bool IsFile() const { return type == fs::file_type::regular; }
+
+    bool IsSymlink() const { return type == fs::file_type::symlink; }
+
+    bool IsHidden() const { return IsHiddenName(name.c_str()); }
+};
+
+/**
+ * 用getdents64批量读取目录项，大部分文件系统通过d_type直接给出类型，不需要逐个stat
+ * 文件系统不提供d_type(DT_UNKNOWN)时才对该项做一次只取类型的statx
+ * 不跟随符号链接，指向目录或文件的符号链接type为symlink，由调用方决定是否跟随
+ */
+class DirReader {
+public:
+    static constexpr std::size_t kBufferSize = 128 * 1024;
+
+    explicit DirReader(const std::string &dir_path) :
+            fd_(::open(dir_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)), buf_len_(0), buf_pos_(0) {}
+
+    DirReader(const DirReader &) = delete;
+
+    DirReader &operator=(const DirReader &) = delete;
+
+    ~DirReader() {
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+
+    bool IsOpen() const { return fd_ >= 0; }
+
+    // 取下一个目录项，跳过.和..；读完或出错时返回false
+    bool Next(DirEntry &entry) {
+        for (;;) {
+            if (buf_pos_ >= buf_len_) {
+                if (!Fill())
+                    return false;
+            }
+            const struct dirent64 *d = reinterpret_cast<const struct dirent64 *>(buf_.get() + buf_pos_);
+            buf_pos_ += d->d_reclen;
+            const char *name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            entry.name.assign(name);
+            entry.type = ToFileType(d->d_type);
+            entry.size = 0;
+            entry.mtime_ns = 0;
+            entry.stat_mask = 0;
+            if (entry.type == fs::file_type::unknown)
+                Stat(entry, STATX_TYPE);
+            return true;
+        }
+    }
+
+    /**
+     * 对entry做一次statx，只取mask中的字段，默认只取文件大小；已经取过的字段不会重复取
+     * 不跟随符号链接，成功返回true
+     */
+    bool Stat(DirEntry &entry, unsigned int mask = STATX_SIZE) {
+        mask &= ~entry.stat_mask;
+        if (0 == mask)
+            return true;
+        struct statx stx;
+        if (0 != ::statx(fd_, entry.name.c_str(), AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, mask, &stx))
+            return false;
+        if (stx.stx_mask & STATX_TYPE)
+            entry.type = ModeToFileType(stx.stx_mode);
+        if (stx.stx_mask & STATX_SIZE)
+            entry.size = stx.stx_size;
+        if (stx.stx_mask & STATX_MTIME)
+            entry.mtime_ns = static_cast<int64_t>(stx.stx_mtime.tv_sec) * 1000000000 + stx.stx_mtime.tv_nsec;
+        entry.stat_mask |= stx.stx_mask & mask;
+        return true;
+    }
+
+private:
+    bool Fill() {
+        if (fd_ < 0)
+            return false;
+        if (!buf_)
+            buf_.reset(new char[kBufferSize]);
+        long n = ::syscall(SYS_getdents64, fd_, buf_.get(), kBufferSize);
+        if (n <= 0)
+            return false;
+        buf_len_ = static_cast<std::size_t>(n);
+        buf_pos_ = 0;
+        return true;
+    }
+
+    static fs::file_type ToFileType(unsigned char d_type) {
+        switch (d_type) {
+            case DT_REG: return fs::file_type::regular;
+            case DT_DIR: return fs::file_type::directory;
+            case DT_LNK: return fs::file_type::symlink;
+            case DT_BLK: return fs::file_type::block;
+            case DT_CHR: return fs::file_type::character;
+            case DT_FIFO: return fs::file_type::fifo;
+            case DT_SOCK: return fs::file_type::socket;
+            default: return fs::file_type::unknown;
+        }
+    }
+
+    static fs::file_type ModeToFileType(mode_t mode) {
+        if (S_ISREG(mode)) return fs::file_type::regular;
+        if (S_ISDIR(mode)) return fs::file_type::directory;
+        if (S_ISLNK(mode)) return fs::file_type::symlink;
+        if (S_ISBLK(mode)) return fs::file_type::block;
+        if (S_ISCHR(mode)) return fs::file_type::character;
+        if (S_ISFIFO(mode)) return fs::file_type::fifo;
+        if (S_ISSOCK(mode)) return fs::file_type::socket;
+        return fs::file_type::unknown;
+    }
+
+    int fd_;
+    std::unique_ptr<char[]> buf_;
+    std::size_t buf_len_;
+    std::size_t buf_pos_;
+};
+
+#endif
+
 }   // namespace file
 }   // namespace util
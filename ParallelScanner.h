@@ -0,0 +1,224 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "util/FileUtil.h"
+#include "util/Queue.h"
+#include "util/ThreadPoolUtil.h"
+
+namespace util {
+namespace file {
+
+class Filter;
+
+/**
+ * 并行目录扫描，每个子目录作为一个任务放到util::ThreadPool中遍历
+ * 进入子目录前先用filter->IsFilterDir剪枝，文件用filter->IsFilterFile过滤，filter为nullptr时不过滤
+ * 通过过滤的文件路径(utf8)放入有界队列，调用方用Next逐个取出，队列满时扫描线程阻塞等待
+ * 不跟随指向目录的符号链接；没有权限或遍历出错的目录直接跳过
+ * Linux下用DirReader读取目录项，filter还需要提供IsFilterFile(u8path, DirReader &, DirEntry &)，
+ * 只有设置了文件尺寸过滤时才对文件做statx
+ * 调用Next的线程不能是pool中的线程，否则队列满时可能死锁
+ *
+ * 用法:
+ *     ParallelScanner<> scanner(pool, &filter);
+ *     scanner.Start(root);
+ *     while (auto path = scanner.Next()) { ... }
+ */
+template<typename FilterT = Filter>
+class ParallelScanner {
+public:
+    ParallelScanner(util::ThreadPool &pool, FilterT *filter = nullptr, std::size_t queue_capacity = 4096) :
+            pool_(pool), filter_(filter), paths_(queue_capacity), pending_dir_num_(0), dir_num_(0), file_num_(0),
+            is_stop_(false), is_started_(false) {}
+
+    ParallelScanner(const ParallelScanner &) = delete;
+
+    ParallelScanner &operator=(const ParallelScanner &) = delete;
+
+    ~ParallelScanner() {
+        Stop();
+    }
+
+    // 开始扫描root，立即返回；每个对象只能Start一次，root不是目录或任务提交失败时返回false
+    bool Start(const std::string &root) {
+        if (is_started_.exchange(true))
+            return false;
+        fs::path p = fs::u8path(root);
+        std::error_code ec;
+        if (!fs::is_directory(p, ec) || (nullptr != filter_ && filter_->IsFilterDir(p.u8string()))) {
+            paths_.SetNoMoreFlag();
+            return false;
+        }
+        // 提交失败时task在这里析构，计数归零并结束队列
+        DirTask task(this, p.u8string());
+        return pool_.Post(std::move(task));
+    }
+
+    // 取出下一个文件路径，阻塞直到有数据；扫描结束并且队列已取空时返回空值
+    std::optional<std::string> Next() {
+        return paths_.pop();
+    }
+
+    // 停止扫描并等待已经开始的任务退出，队列中未取出的路径被丢弃
+    void Stop() {
+        is_stop_.store(true);
+        std::unique_lock<std::mutex> lk(mutex_);
+        while (pending_dir_num_.load() > 0) {
+            // 扫描线程可能阻塞在满的队列上，先取空队列让其退出
+            lk.unlock();
+            while (paths_.try_pop()) {
+            }
+            lk.lock();
+            done_cv_.wait_for(lk, std::chrono::milliseconds(1), [this]() { return pending_dir_num_.load() == 0; });
+        }
+    }
+
+    // 等待扫描完成，不取出队列中的数据，只能在队列容量足够或另有线程调用Next时使用
+    void Wait() {
+        std::unique_lock<std::mutex> lk(mutex_);
+        done_cv_.wait(lk, [this]() { return pending_dir_num_.load() == 0; });
+    }
+
+    bool IsDone() const { return pending_dir_num_.load() == 0 && is_started_.load(); }
+
+    // 已遍历的目录数
+    uint64_t GetDirNum() const { return dir_num_.load(); }
+
+    // 已放入队列的文件数
+    uint64_t GetFileNum() const { return file_num_.load(); }
+
+private:
+    /**
+     * 一个目录的扫描任务，构造时增加pending_dir_num_，析构时减少
+     * 线程池丢弃没有执行的任务(ShutDownNow等)时任务对象同样会析构，计数总能归零，Next/Stop不会一直等待
+     */
+    class DirTask {
+    public:
+        DirTask(ParallelScanner *scanner, std::string dir) : scanner_(scanner), dir_(std::move(dir)) {
+            ++scanner_->pending_dir_num_;
+        }
+
+        DirTask(DirTask &&rhs) noexcept : scanner_(rhs.scanner_), dir_(std::move(rhs.dir_)) {
+            rhs.scanner_ = nullptr;
+        }
+
+        DirTask(const DirTask &) = delete;
+
+        DirTask &operator=(const DirTask &) = delete;
+
+        DirTask &operator=(DirTask &&) = delete;
+
+        ~DirTask() {
+            if (nullptr != scanner_)
+                scanner_->FinishDir();
+        }
+
+        void operator()() {
+            if (nullptr != scanner_)
+                scanner_->ScanDir(dir_);
+        }
+
+    private:
+        ParallelScanner *scanner_;
+        std::string dir_;
+    };
+
+    void ScanDir(const std::string &dir) {
+        if (is_stop_.load())
+            return;
+        std::vector<std::string> sub_dirs;
+        ListDir(dir, sub_dirs);
+        ++dir_num_;
+
+        for (std::string &sub_dir : sub_dirs) {
+            if (is_stop_.load())
+                break;
+            DirTask task(this, std::move(sub_dir));
+            // 提交失败(线程池已关闭或拒绝任务)时task没有被取走，在当前线程继续遍历
+            if (!pool_.Post(std::move(task)))
+                task();
+        }
+    }
+
+    // 通过过滤的文件放入队列，需要继续遍历的子目录放入sub_dirs
+    void ListDir(const std::string &dir, std::vector<std::string> &sub_dirs) {
+#ifdef __linux__
+        DirReader reader(dir);
+        DirEntry entry;
+        std::string u8path = dir;
+        if (u8path.empty() || u8path.back() != '/')
+            u8path += '/';
+        const std::size_t base_len = u8path.size();
+        while (!is_stop_.load() && reader.Next(entry)) {
+            u8path.resize(base_len);
+            u8path += entry.name;
+            if (entry.IsDir()) {
+                if (nullptr == filter_ || !filter_->IsFilterDir(u8path))
+                    sub_dirs.push_back(u8path);
+            } else if (entry.IsFile()) {
+                if (nullptr == filter_ || !filter_->IsFilterFile(u8path, reader, entry))
+                    PushPath(u8path);
+            } else if (entry.IsSymlink() && CheckIsFile(u8path)) {
+                // 指向文件的符号链接按目标文件过滤，与fs::is_regular_file的行为一致
+                if (nullptr == filter_ || !filter_->IsFilterFile(u8path))
+                    PushPath(u8path);
+            }
+        }
+#else
+        std::error_code ec;
+        fs::directory_iterator it(fs::u8path(dir), fs::directory_options::skip_permission_denied, ec);
+        for (fs::directory_iterator end; !ec && it != end && !is_stop_.load(); it.increment(ec)) {
+            const fs::directory_entry &entry = *it;
+            std::error_code type_ec;
+            if (entry.is_directory(type_ec) && !entry.is_symlink(type_ec)) {
+                std::string u8path = entry.path().u8string();
+                if (nullptr == filter_ || !filter_->IsFilterDir(u8path))
+                    sub_dirs.push_back(std::move(u8path));
+            } else if (entry.is_regular_file(type_ec)) {
+                std::string u8path = entry.path().u8string();
+                if (nullptr == filter_ || !filter_->IsFilterFile(u8path))
+                    PushPath(u8path);
+            }
+        }
+#endif
+    }
+
+    void PushPath(const std::string &u8path) {
+        paths_.push(u8path);
+        ++file_num_;
+    }
+
+    // 在锁内减计数，保证Stop/Wait返回时没有扫描线程还在访问本对象
+    void FinishDir() {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (1 == pending_dir_num_.fetch_sub(1)) {
+            paths_.SetNoMoreFlag();
+            done_cv_.notify_all();
+        }
+    }
+
+    util::ThreadPool &pool_;
+    FilterT *filter_;
+    util::MPMCQueue<std::string> paths_;
+    std::atomic<int64_t> pending_dir_num_;
+    std::atomic<uint64_t> dir_num_;
+    std::atomic<uint64_t> file_num_;
+    std::atomic<bool> is_stop_;
+    std::atomic<bool> is_started_;
+    std::mutex mutex_;
+    std::condition_variable done_cv_;
+};
+
+}   // namespace file
+}   // namespace util
@@ -6,8 +6,21 @@
 #define LIB_IMAGEDUPLICATE_SDK_QUEUE_H
 
 #include <queue>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <algorithm>
 #include <mutex>
 #include <string>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
 
 namespace util {
 
@@ -17,11 +30,41 @@ public:
     Queue() : is_no_more_(false) {}
     
     void push(const T &item) {
+        emplace(item);
+    }
+    
+    void push(T &&item) {
+        emplace(std::move(item));
+    }
+    
+    template<typename... Args>
+    void emplace(Args &&... args) {
+        // 与原来的push一样在锁内通知，实测在锁外通知时多生产者多消费者的吞吐更低且波动很大(见queue_bench)
         std::lock_guard<std::mutex> lk(mutex_);
-        queue_.push(std::make_shared<T>(item));
+        queue_.emplace_back(std::forward<Args>(args)...);
         cv_.notify_one();
     }
     
+    // 一次加锁放入range中的所有元素，range为右值时移动元素，否则拷贝
+    template<typename Range>
+    void push_bulk(Range &&range) {
+        std::size_t count = 0;
+        std::lock_guard<std::mutex> lk(mutex_);
+        for (auto &item : range) {
+            if constexpr (std::is_lvalue_reference<Range>::value) {
+                queue_.push_back(item);
+            } else {
+                queue_.push_back(std::move(item));
+            }
+            ++count;
+        }
+        if (count == 1) {
+            cv_.notify_one();
+        } else if (count > 1) {
+            cv_.notify_all();
+        }
+    }
+    
     std::shared_ptr<T> pop() {
         std::unique_lock<std::mutex> lk(mutex_);
         
@@ -32,35 +75,450 @@ public:
         if (queue_.empty())
             return nullptr;
         
-        std::shared_ptr<T> tmp = queue_.front();
-        queue_.pop();
+        std::shared_ptr<T> tmp = std::make_shared<T>(std::move(queue_.front()));
+        queue_.pop_front();
         return tmp;
     }
     
+    /**
+     * 一次加锁取出最多max_n个元素追加到out的末尾，返回取出的个数
+     * 队列为空时最多等待timeout；返回0表示超时，或者已经SetNoMoreFlag并且队列已空
+     */
+    template<typename Rep, typename Period>
+    std::size_t pop_bulk(std::vector<T> &out, std::size_t max_n, const std::chrono::duration<Rep, Period> &timeout) {
+        std::unique_lock<std::mutex> lk(mutex_);
+        
+        cv_.wait_for(lk, timeout, [this]() {
+            return (!queue_.empty()) || is_no_more_;
+        });
+        
+        std::size_t count = std::min(max_n, queue_.size());
+        for (std::size_t i = 0; i < count; ++i) {
+            out.push_back(std::move(queue_.front()));
+            queue_.pop_front();
+        }
+        return count;
+    }
+    
+    // 同上，队列为空时一直等待；返回0表示已经SetNoMoreFlag并且队列已空
+    std::size_t pop_bulk(std::vector<T> &out, std::size_t max_n) {
+        std::unique_lock<std::mutex> lk(mutex_);
+        
+        cv_.wait(lk, [this]() {
+            return (!queue_.empty()) || is_no_more_;
+        });
+        
+        std::size_t count = std::min(max_n, queue_.size());
+        for (std::size_t i = 0; i < count; ++i) {
+            out.push_back(std::move(queue_.front()));
+            queue_.pop_front();
+        }
+        return count;
+    }
+    
     void clear() {
-        is_no_more_ = false;
         std::lock_guard<std::mutex> lk(mutex_);
-        std::queue<std::shared_ptr<T>> empty;
+        is_no_more_ = false;
+        std::deque<T> empty;
         queue_.swap(empty);
     }
     
     bool empty() {
+        std::lock_guard<std::mutex> lk(mutex_);
         return queue_.empty();
     }
     
     void SetNoMoreFlag() {
-        is_no_more_ = true;
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            is_no_more_ = true;
+        }
         cv_.notify_all();
     }
     
     bool IsNoMore() const { return is_no_more_; }
 
 private:
-    std::queue<std::shared_ptr<T>> queue_;
+    // 元素按值存放，只有pop()返回时才包装成shared_ptr，push_bulk/pop_bulk不会为每个元素分配内存
+    std::deque<T> queue_;
     
     std::mutex mutex_;
     std::condition_variable cv_;
-    bool is_no_more_;
+    std::atomic<bool> is_no_more_;
+};
+
+/**
+ * 有界无锁多生产者多消费者环形队列(Dmitry Vyukov的bounded MPMC queue)
+ * 与Queue语义相同: pop阻塞直到有数据，SetNoMoreFlag之后队列取空时pop返回空值
+ * 元素按值存放，支持只能移动的类型；队列满时push阻塞
+ * 取不到数据时先自旋一段时间，仍然取不到才在条件变量上休眠，没有线程休眠时push/pop都不加锁
+ */
+template<typename T>
+class MPMCQueue {
+public:
+    static constexpr std::size_t kCacheLineSize = 64;
+    
+    // 容量向上取整为2的幂
+    explicit MPMCQueue(std::size_t capacity) : is_no_more_(false), push_waiter_num_(0), pop_waiter_num_(0) {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask_ = size - 1;
+        cells_.reset(new Cell[size]);
+        for (std::size_t i = 0; i < size; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        enqueue_pos_.store(0, std::memory_order_relaxed);
+        dequeue_pos_.store(0, std::memory_order_relaxed);
+    }
+    
+    MPMCQueue(const MPMCQueue &) = delete;
+    
+    MPMCQueue &operator=(const MPMCQueue &) = delete;
+    
+    ~MPMCQueue() {
+        while (try_pop()) {
+        }
+    }
+    
+    bool try_push(const T &item) { return try_emplace(item); }
+    
+    bool try_push(T &&item) { return try_emplace(std::move(item)); }
+    
+    template<typename... Args>
+    bool try_emplace(Args &&... args) {
+        Cell *cell = nullptr;
+        std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        new(cell->Data()) T(std::forward<Args>(args)...);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        Notify(pop_waiter_num_, pop_cv_);
+        return true;
+    }
+    
+    void push(const T &item) { emplace(item); }
+    
+    void push(T &&item) { emplace(std::move(item)); }
+    
+    // 队列满时先自旋，再休眠等待消费者取走数据
+    template<typename... Args>
+    void emplace(Args &&... args) {
+        for (int i = 0; i < kSpinCount; ++i) {
+            if (try_emplace(std::forward<Args>(args)...)) {
+                return;
+            }
+            Pause(i);
+        }
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lk(mutex_);
+                ++push_waiter_num_;
+                push_cv_.wait(lk, [this]() { return !full(); });
+                --push_waiter_num_;
+            }
+            if (try_emplace(std::forward<Args>(args)...)) {
+                return;
+            }
+        }
+    }
+    
+    std::optional<T> try_pop() {
+        Cell *cell = nullptr;
+        std::size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return std::nullopt;
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        T *data = cell->Data();
+        std::optional<T> item(std::move(*data));
+        data->~T();
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        Notify(push_waiter_num_, push_cv_);
+        return item;
+    }
+    
+    // 阻塞直到取到数据；SetNoMoreFlag之后队列为空时返回空值
+    std::optional<T> pop() {
+        for (int i = 0;; ++i) {
+            std::optional<T> item = try_pop();
+            if (item) {
+                return item;
+            }
+            if (is_no_more_.load() && empty()) {
+                return std::nullopt;
+            }
+            if (i < kSpinCount) {
+                Pause(i);
+                continue;
+            }
+            std::unique_lock<std::mutex> lk(mutex_);
+            ++pop_waiter_num_;
+            pop_cv_.wait(lk, [this]() { return !empty() || is_no_more_.load(); });
+            --pop_waiter_num_;
+        }
+    }
+    
+    void clear() {
+        while (try_pop()) {
+        }
+        is_no_more_ = false;
+    }
+    
+    // 已被生产者占用的位置也算作非空，该数据可能还没有写完
+    bool empty() const {
+        return enqueue_pos_.load() == dequeue_pos_.load();
+    }
+    
+    bool full() const {
+        return enqueue_pos_.load() - dequeue_pos_.load() > mask_;
+    }
+    
+    std::size_t capacity() const { return mask_ + 1; }
+    
+    void SetNoMoreFlag() {
+        is_no_more_ = true;
+        std::lock_guard<std::mutex> lk(mutex_);
+        pop_cv_.notify_all();
+    }
+    
+    bool IsNoMore() const { return is_no_more_; }
+
+private:
+    static constexpr int kSpinCount = 128;
+    
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        
+        T *Data() { return std::launder(reinterpret_cast<T *>(&storage)); }
+    };
+    
+    static void Pause(int spin) {
+        if (spin > kSpinCount / 2) {
+            std::this_thread::yield();
+        }
+    }
+    
+    // 休眠的线程先在锁内增加等待计数再检查队列状态，这里先修改队列再检查等待计数，
+    // 两边至少有一方能看到对方的修改，所以没有线程休眠时不需要加锁
+    void Notify(std::atomic<int> &waiter_num, std::condition_variable &cv) {
+        if (waiter_num.load() > 0) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            cv.notify_one();
+        }
+    }
+    
+    std::unique_ptr<Cell[]> cells_;
+    std::size_t mask_;
+    
+    alignas(kCacheLineSize) std::atomic<std::size_t> enqueue_pos_;
+    alignas(kCacheLineSize) std::atomic<std::size_t> dequeue_pos_;
+    alignas(kCacheLineSize) std::atomic<bool> is_no_more_;
+    std::atomic<int> push_waiter_num_;
+    std::atomic<int> pop_waiter_num_;
+    std::mutex mutex_;
+    std::condition_variable push_cv_;
+    std::condition_variable pop_cv_;
+};
+
+/**
+ * 单生产者单消费者的环形队列，只能有一个线程push、一个线程pop
+ * 容量为2的幂，生产者和消费者各自缓存对方的下标，只有缓存的下标显示队列满/空时才去读对方的原子变量，
+ * 正常情况下一次push/pop只访问自己独占的缓存行
+ * SetNoMoreFlag与Queue相同，之后队列取空时pop返回空值；阻塞时先自旋再休眠
+ */
+template<typename T>
+class SPSCQueue {
+public:
+    static constexpr std::size_t kCacheLineSize = 64;
+    
+    // 容量向上取整为2的幂
+    explicit SPSCQueue(std::size_t capacity) : is_no_more_(false), push_waiter_num_(0), pop_waiter_num_(0) {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask_ = size - 1;
+        slots_.reset(new Slot[size]);
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+        cached_head_ = 0;
+        cached_tail_ = 0;
+    }
+    
+    SPSCQueue(const SPSCQueue &) = delete;
+    
+    SPSCQueue &operator=(const SPSCQueue &) = delete;
+    
+    ~SPSCQueue() {
+        std::size_t head = head_.load(std::memory_order_relaxed);
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        for (; head != tail; ++head) {
+            slots_[head & mask_].Data()->~T();
+        }
+    }
+    
+    bool try_push(const T &item) { return try_emplace(item); }
+    
+    bool try_push(T &&item) { return try_emplace(std::move(item)); }
+    
+    template<typename... Args>
+    bool try_emplace(Args &&... args) {
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ > mask_) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ > mask_) {
+                return false;
+            }
+        }
+        new(slots_[tail & mask_].Data()) T(std::forward<Args>(args)...);
+        tail_.store(tail + 1, std::memory_order_release);
+        Notify(pop_waiter_num_, pop_cv_);
+        return true;
+    }
+    
+    void push(const T &item) { emplace(item); }
+    
+    void push(T &&item) { emplace(std::move(item)); }
+    
+    // 队列满时先自旋，再休眠等待消费者取走数据
+    template<typename... Args>
+    void emplace(Args &&... args) {
+        for (int i = 0;; ++i) {
+            if (try_emplace(std::forward<Args>(args)...)) {
+                return;
+            }
+            if (i < kSpinCount) {
+                Pause(i);
+                continue;
+            }
+            std::unique_lock<std::mutex> lk(mutex_);
+            ++push_waiter_num_;
+            push_cv_.wait(lk, [this]() { return !full(); });
+            --push_waiter_num_;
+        }
+    }
+    
+    std::optional<T> try_pop() {
+        std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_) {
+                return std::nullopt;
+            }
+        }
+        T *data = slots_[head & mask_].Data();
+        std::optional<T> item(std::move(*data));
+        data->~T();
+        head_.store(head + 1, std::memory_order_release);
+        Notify(push_waiter_num_, push_cv_);
+        return item;
+    }
+    
+    // 阻塞直到取到数据；SetNoMoreFlag之后队列为空时返回空值
+    std::optional<T> pop() {
+        for (int i = 0;; ++i) {
+            std::optional<T> item = try_pop();
+            if (item) {
+                return item;
+            }
+            if (is_no_more_.load() && empty()) {
+                return std::nullopt;
+            }
+            if (i < kSpinCount) {
+                Pause(i);
+                continue;
+            }
+            std::unique_lock<std::mutex> lk(mutex_);
+            ++pop_waiter_num_;
+            pop_cv_.wait(lk, [this]() { return !empty() || is_no_more_.load(); });
+            --pop_waiter_num_;
+        }
+    }
+    
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+    
+    bool full() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire) > mask_;
+    }
+    
+    std::size_t capacity() const { return mask_ + 1; }
+    
+    void SetNoMoreFlag() {
+        is_no_more_ = true;
+        std::lock_guard<std::mutex> lk(mutex_);
+        pop_cv_.notify_all();
+    }
+    
+    bool IsNoMore() const { return is_no_more_; }
+
+private:
+    static constexpr int kSpinCount = 128;
+    
+    struct Slot {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        
+        T *Data() { return std::launder(reinterpret_cast<T *>(&storage)); }
+    };
+    
+    static void Pause(int spin) {
+        if (spin > kSpinCount / 2) {
+            std::this_thread::yield();
+        }
+    }
+    
+    // 与MPMCQueue相同，修改下标之后需要一个全屏障再检查等待计数，保证不会漏掉唤醒
+    void Notify(std::atomic<int> &waiter_num, std::condition_variable &cv) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiter_num.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            cv.notify_one();
+        }
+    }
+    
+    std::unique_ptr<Slot[]> slots_;
+    std::size_t mask_;
+    
+    // 消费者独占
+    alignas(kCacheLineSize) std::atomic<std::size_t> head_;
+    std::size_t cached_tail_;
+    
+    // 生产者独占
+    alignas(kCacheLineSize) std::atomic<std::size_t> tail_;
+    std::size_t cached_head_;
+    
+    alignas(kCacheLineSize) std::atomic<bool> is_no_more_;
+    std::atomic<int> push_waiter_num_;
+    std::atomic<int> pop_waiter_num_;
+    std::mutex mutex_;
+    std::condition_variable push_cv_;
+    std::condition_variable pop_cv_;
 };
 
 }  // namespace util
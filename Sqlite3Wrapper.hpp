@@ -2,46 +2,249 @@
 #define SQLITE3WRAPPER_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <chrono>
 #include <unordered_map>
 #include <map>
+#include <list>
+#include <algorithm>
+#include <type_traits>
+#include <tuple>
+#include <optional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <thread>
+#include <cctype>
+#include <cstring>
 
 #include "sqlite3.h"
 
 #include "LogUtil.hpp"
 #include "util/FileUtil.hpp"
+#include "util/Queue.h"
+#include "util/JsonUtil.h"
+#include "spdlog/spdlog.h"
 
-struct SQLiteMapHash
+// 一个连接的共享状态，连接和在它上面编译的每条语句各持有一份，连接关闭后仍然有效
+// CloseDB统一finalize了连接上剩余的语句之后置位，此后语句析构时不能再finalize
+struct SQLite3ConnState
 {
-	std::size_t operator()(const std::pair<sqlite3*, std::chrono::system_clock::time_point> &k) const
-	{
-		size_t h1 = std::hash<sqlite3*>()(k.first);
-		size_t h2 = std::hash<uint64_t>()(std::chrono::duration_cast<std::chrono::milliseconds>(k.second.time_since_epoch()).count());
-		h1 ^= h2 + 0x9e3779b9 + (h1 << 6) + (h1 >> 2);
+	SQLite3ConnState() : is_stmt_finalized(false) {}
 
-		return h1;
-	}
+	std::atomic<bool> is_stmt_finalized;
+};
+
+// 指向一段只读字节的视图，不拥有数据
+struct SQLite3ByteSpan
+{
+	SQLite3ByteSpan() : data_(nullptr), size_(0) {}
+	SQLite3ByteSpan(const unsigned char *data, size_t size) : data_(data), size_(size) {}
+	SQLite3ByteSpan(const std::vector<unsigned char> &data) : data_(data.data()), size_(data.size()) {}
+
+	const unsigned char *data() const { return data_; }
+	size_t size() const { return size_; }
+	bool empty() const { return size_ == 0; }
+	const unsigned char *begin() const { return data_; }
+	const unsigned char *end() const { return data_ + size_; }
+	unsigned char operator[](size_t i) const { return data_[i]; }
+
+private:
+	const unsigned char *data_;
+	size_t size_;
 };
 
-struct SQLiteMapEqual
+// 列式的一批查询结果，每列类型在构造时固定: SQLITE_INTEGER/SQLITE_FLOAT存放在连续的数组中，
+// SQLITE_TEXT/SQLITE_BLOB的内容依次拼接在一块缓冲区中，用offsets定位第i行的[offsets[i], offsets[i + 1])
+// SQLITE_NULL列不读取数据，只记录IsNull；其它类型值按SQLITE_TEXT处理
+// NULL在整数/浮点列中读作0，在文本/二进制列中为空串，可以通过IsNull区分；批次之间复用内存
+class SQLite3ColumnBatch
 {
-	bool operator()(const std::pair<sqlite3*, std::chrono::system_clock::time_point> &lhs, const std::pair<sqlite3*, std::chrono::system_clock::time_point> &rhs) const
+public:
+	static constexpr size_t kDefaultCapacity = 1024;
+
+	explicit SQLite3ColumnBatch(const std::vector<int> &column_types, size_t capacity = kDefaultCapacity)
+		: capacity_(capacity > 0 ? capacity : 1), size_(0), columns_(column_types.size())
+	{
+		for (size_t i = 0; i < columns_.size(); ++i)
+		{
+			Column &column = columns_[i];
+			column.type = column_types[i];
+			column.is_null.reserve(capacity_);
+			if (column.type == SQLITE_INTEGER)
+				column.ints.reserve(capacity_);
+			else if (column.type == SQLITE_FLOAT)
+				column.doubles.reserve(capacity_);
+			else if (column.type == SQLITE_BLOB)
+				column.offsets.reserve(capacity_ + 1);
+			else if (column.type != SQLITE_NULL)
+			{
+				column.type = SQLITE_TEXT;
+				column.offsets.reserve(capacity_ + 1);
+			}
+		}
+		Clear();
+	}
+
+	size_t Size() const
+	{
+		return size_;
+	}
+
+	size_t Capacity() const
+	{
+		return capacity_;
+	}
+
+	int GetColumnCount() const
+	{
+		return (int)columns_.size();
+	}
+
+	const int64_t *GetInt64Column(int col) const
+	{
+		return columns_[col].ints.data();
+	}
+
+	const double *GetDoubleColumn(int col) const
+	{
+		return columns_[col].doubles.data();
+	}
+
+	std::string_view GetText(int col, size_t row) const
 	{
-		return lhs.first == rhs.first && lhs.second == rhs.second;
+		const Column &column = columns_[col];
+		return std::string_view(column.arena.data() + column.offsets[row], column.offsets[row + 1] - column.offsets[row]);
 	}
+
+	SQLite3ByteSpan GetBlob(int col, size_t row) const
+	{
+		const Column &column = columns_[col];
+		return SQLite3ByteSpan((const unsigned char *)column.arena.data() + column.offsets[row], column.offsets[row + 1] - column.offsets[row]);
+	}
+
+	bool IsNull(int col, size_t row) const
+	{
+		return columns_[col].is_null[row] != 0;
+	}
+
+	void Clear()
+	{
+		size_ = 0;
+		for (Column &column : columns_)
+		{
+			column.ints.clear();
+			column.doubles.clear();
+			column.arena.clear();
+			column.offsets.assign(1, 0);
+			column.is_null.clear();
+		}
+	}
+
+	// 读取stmt当前行追加到批次末尾，由SQLite3Stmt::FetchBatch调用
+	// 成功返回SQLITE_OK；读取文本/二进制时内存不足返回SQLITE_NOMEM，此时不追加该行
+	int AppendRow(sqlite3_stmt *stmt)
+	{
+		for (size_t i = 0; i < columns_.size(); ++i)
+		{
+			Column &column = columns_[i];
+			bool is_null = sqlite3_column_type(stmt, (int)i) == SQLITE_NULL;
+			column.is_null.push_back(is_null);
+			switch (column.type)
+			{
+			case SQLITE_INTEGER:
+				column.ints.push_back(sqlite3_column_int64(stmt, (int)i));
+				break;
+			case SQLITE_FLOAT:
+				column.doubles.push_back(sqlite3_column_double(stmt, (int)i));
+				break;
+			case SQLITE_BLOB:
+			case SQLITE_TEXT:
+				{
+					// 先取数据再取长度，长度对应的是转换之后的格式
+					const char *data = column.type == SQLITE_BLOB ? (const char *)sqlite3_column_blob(stmt, (int)i) : (const char *)sqlite3_column_text(stmt, (int)i);
+					int bytes = sqlite3_column_bytes(stmt, (int)i);
+					// 空的BLOB也返回NULL，只有错误码为SQLITE_NOMEM时才是内存不足
+					if (!data && !is_null && sqlite3_errcode(sqlite3_db_handle(stmt)) == SQLITE_NOMEM)
+					{
+						Truncate(size_);
+						return SQLITE_NOMEM;
+					}
+					if (data)
+						column.arena.append(data, bytes);
+					column.offsets.push_back(column.arena.size());
+				}
+				break;
+			default:
+				// SQLITE_NULL列只记录is_null
+				break;
+			}
+		}
+		++size_;
+
+		return SQLITE_OK;
+	}
+
+private:
+	struct Column
+	{
+		int type;
+		std::vector<int64_t> ints;
+		std::vector<double> doubles;
+		std::string arena;
+		std::vector<size_t> offsets;
+		std::vector<uint8_t> is_null;
+	};
+
+	// 丢弃rows之后的数据，用于撤销追加了一半的行
+	void Truncate(size_t rows)
+	{
+		for (Column &column : columns_)
+		{
+			column.is_null.resize(std::min(column.is_null.size(), rows));
+			column.ints.resize(std::min(column.ints.size(), rows));
+			column.doubles.resize(std::min(column.doubles.size(), rows));
+			if (column.offsets.size() > rows + 1)
+			{
+				column.offsets.resize(rows + 1);
+				column.arena.resize(column.offsets.back());
+			}
+		}
+		size_ = rows;
+	}
+
+	size_t capacity_;
+	size_t size_;
+	std::vector<Column> columns_;
 };
 
+template <typename T>
+struct SQLite3IsOptional : std::false_type {};
+
+template <typename T>
+struct SQLite3IsOptional<std::optional<T>> : std::true_type {};
+
+template <typename T>
+struct SQLite3AlwaysFalse : std::false_type {};
+
+template <typename... Ts>
+class SQLite3Rows;
+
 class SQLite3Stmt
 {
 	friend class SQLite3Wrapper;
 public:
-	SQLite3Stmt(const std::string &sql = "") : stmt_(nullptr), db_(nullptr), sql_(sql)
+	SQLite3Stmt(const std::string &sql = "") : status_(SQLITE_OK), stmt_(nullptr), db_(nullptr), sql_(sql), is_row_pending_(false)
 	{
 
 	}
 
-	SQLite3Stmt(SQLite3Stmt &&rhs) : stmt_(rhs.stmt_), db_(rhs.db_), sql_(std::move(rhs.sql_)), status_(rhs.status_), open_time_(rhs.open_time_)
+	SQLite3Stmt(SQLite3Stmt &&rhs) : status_(rhs.status_), stmt_(rhs.stmt_), db_(rhs.db_), conn_state_(std::move(rhs.conn_state_)), sql_(std::move(rhs.sql_)), owned_params_(std::move(rhs.owned_params_)), is_row_pending_(rhs.is_row_pending_)
 	{
 		rhs.SetNull();
 	}
@@ -54,8 +257,10 @@ public:
 			sql_ = rhs.sql_;
 			stmt_ = rhs.stmt_;
 			db_ = rhs.db_;
-			open_time_ = rhs.open_time_;
+			conn_state_ = std::move(rhs.conn_state_);
 			status_ = rhs.status_;
+			owned_params_ = std::move(rhs.owned_params_);
+			is_row_pending_ = rhs.is_row_pending_;
 			rhs.SetNull();
 		}
 
@@ -73,14 +278,11 @@ public:
 		return status_;
 	}
 
-	int Prepare(sqlite3 *db, std::chrono::system_clock::time_point open_time, const char **pzTail)
+	int Prepare(sqlite3 *db, std::shared_ptr<SQLite3ConnState> conn_state, const char **pzTail)
 	{
 		db_ = db;
-		open_time_ = open_time;
-		auto sqlite_close_flag_it = sqlite_db_close_map.find({ db_, open_time_ });
-		if (sqlite_close_flag_it == sqlite_db_close_map.end())
-			sqlite_db_close_map.insert({ { db_, open_time_ }, false });
-
+		conn_state_ = std::move(conn_state);
+		is_row_pending_ = false;
 
 		return status_ = sqlite3_prepare_v2(db, sql_.data(), (int)sql_.size(), &stmt_, pzTail);
 	}
@@ -90,20 +292,16 @@ public:
 		int ret = 0;
 		if (stmt_)
 		{
-			auto close_flag_it = sqlite_db_close_map.find({ db_ ,open_time_ });
-			if (close_flag_it != sqlite_db_close_map.end())
+			// 没有连接状态的语句不在CloseDB的管理之内，总是由自己finalize
+			if (!conn_state_ || !conn_state_->is_stmt_finalized.load(std::memory_order_acquire))
 			{
-				if (!close_flag_it->second)
-				{
-					ret = sqlite3_finalize(stmt_);
-				}
-				else
-				{
-					sqlite_db_close_map.erase(close_flag_it);
-				}
+				ret = sqlite3_finalize(stmt_);
 			}
 			stmt_ = nullptr;
 		}
+		conn_state_.reset();
+		owned_params_.reset();
+		is_row_pending_ = false;
 
 		status_ = ret;
 		return ret;
@@ -139,26 +337,49 @@ public:
 		return ret;
 	}
 
-	int BindText(int pos, const std::string &str, void(*destructor_type)(void*))
+	// destructor_type为SQLITE_STATIC时SQLite不拷贝数据，调用方要保证数据在重新绑定、ClearBindings或Finalize之前有效
+	// 为SQLITE_TRANSIENT时SQLite在绑定时拷贝一份
+	int BindText(int pos, std::string_view str, void(*destructor_type)(void*))
 	{
 		int ret = 0;
 		if (stmt_)
-			ret = sqlite3_bind_text(stmt_, pos, str.c_str(), str.size(), destructor_type);
+			ret = sqlite3_bind_text64(stmt_, pos, str.data(), str.size(), destructor_type, SQLITE_UTF8);
 
 		status_ = ret;
 		return ret;
 	}
 
-	int BindBlob(int pos, const std::vector<unsigned char> blob_data, void(*destructor_type)(void*))
+	int BindBlob(int pos, SQLite3ByteSpan blob_data, void(*destructor_type)(void*))
 	{
 		int ret = 0;
 		if (stmt_)
-			ret = sqlite3_bind_blob(stmt_, pos, blob_data.data(), blob_data.size(), destructor_type);
+			ret = sqlite3_bind_blob64(stmt_, pos, blob_data.data(), blob_data.size(), destructor_type);
 
 		status_ = ret;
 		return ret;
 	}
 
+	// 数据的所有权转移给语句，直到该参数被重新以这种方式绑定、ClearBindings或Finalize，不做任何拷贝
+	int BindText(int pos, std::string &&str)
+	{
+		std::string *slot = GetOwnedParam(pos, &OwnedParams::texts);
+		if (!slot)
+			return status_ = (stmt_ ? SQLITE_RANGE : 0);
+
+		*slot = std::move(str);
+		return BindText(pos, *slot, SQLITE_STATIC);
+	}
+
+	int BindBlob(int pos, std::vector<unsigned char> &&blob_data)
+	{
+		std::vector<unsigned char> *slot = GetOwnedParam(pos, &OwnedParams::blobs);
+		if (!slot)
+			return status_ = (stmt_ ? SQLITE_RANGE : 0);
+
+		*slot = std::move(blob_data);
+		return BindBlob(pos, *slot, SQLITE_STATIC);
+	}
+
     int BindNull(int pos)
     {
         int ret = 0;
@@ -225,6 +446,152 @@ public:
 		return {};
 	}
 
+	// 返回的视图指向SQLite内部的缓冲区，在下一次Step/ResetStmt/Finalize之前有效，不会拷贝数据
+	std::string_view GetColumnTextView(int pos)
+	{
+		if (stmt_)
+		{
+			const char *str = (const char *)sqlite3_column_text(stmt_, pos);
+			if (str)
+			{
+				return std::string_view(str, sqlite3_column_bytes(stmt_, pos));
+			}
+		}
+
+		return {};
+	}
+
+	SQLite3ByteSpan GetColumnBlobView(int pos)
+	{
+		if (stmt_)
+		{
+			const unsigned char *byte_ptr = (const unsigned char *)sqlite3_column_blob(stmt_, pos);
+			if (byte_ptr)
+			{
+				return SQLite3ByteSpan(byte_ptr, sqlite3_column_bytes(stmt_, pos));
+			}
+		}
+
+		return {};
+	}
+
+	// 把列的内容追加到调用方的缓冲区后面，缓冲区可以在多行之间复用，返回追加的字节数
+	size_t AppendColumnText(int pos, std::string &out)
+	{
+		std::string_view str = GetColumnTextView(pos);
+		out.append(str.data(), str.size());
+
+		return str.size();
+	}
+
+	size_t AppendColumnBlob(int pos, std::vector<unsigned char> &out)
+	{
+		SQLite3ByteSpan blob = GetColumnBlobView(pos);
+		out.insert(out.end(), blob.begin(), blob.end());
+
+		return blob.size();
+	}
+
+	// 按编译期类型读取列: 整数、浮点数、std::string、std::string_view、std::vector<unsigned char>、SQLite3ByteSpan
+	// std::optional<T>在列为NULL时返回std::nullopt；视图类型的有效期同GetColumnTextView
+	template <typename T>
+	T GetColumn(int pos)
+	{
+		if constexpr (SQLite3IsOptional<T>::value)
+		{
+			if (GetColumnType(pos) == SQLITE_NULL)
+				return std::nullopt;
+
+			return GetColumn<typename T::value_type>(pos);
+		}
+		else if constexpr (std::is_integral<T>::value)
+		{
+			if constexpr (sizeof(T) < sizeof(int) || (sizeof(T) == sizeof(int) && std::is_signed<T>::value))
+				return (T)GetColumnInt(pos);
+			else
+				return (T)GetColumnInt64(pos);
+		}
+		else if constexpr (std::is_floating_point<T>::value)
+		{
+			return (T)GetColumnDouble(pos);
+		}
+		else if constexpr (std::is_same<T, std::string_view>::value)
+		{
+			return GetColumnTextView(pos);
+		}
+		else if constexpr (std::is_same<T, std::string>::value)
+		{
+			std::string_view str = GetColumnTextView(pos);
+			return std::string(str.data(), str.size());
+		}
+		else if constexpr (std::is_same<T, SQLite3ByteSpan>::value)
+		{
+			return GetColumnBlobView(pos);
+		}
+		else if constexpr (std::is_same<T, std::vector<unsigned char>>::value)
+		{
+			SQLite3ByteSpan blob = GetColumnBlobView(pos);
+			return std::vector<unsigned char>(blob.begin(), blob.end());
+		}
+		else
+		{
+			static_assert(SQLite3AlwaysFalse<T>::value, "unsupported column type");
+		}
+	}
+
+	// 逐行Step并把每一行按Ts读成std::tuple<Ts...>，例如:
+	// for (auto [id, path] : stmt.Rows<int64_t, std::string_view>())
+	// 循环结束后Status()为SQLITE_DONE或错误码，需要重新执行时先ResetStmt
+	template <typename... Ts>
+	SQLite3Rows<Ts...> Rows()
+	{
+		return SQLite3Rows<Ts...>(this);
+	}
+
+	// 从第1个参数开始依次绑定，遇到错误时停止并返回错误码
+	// std::string/std::vector<unsigned char>的右值转移给语句，其它字符串和二进制以SQLITE_STATIC绑定，需要在Step之前保持有效
+	// nullptr、std::nullopt和空的std::optional绑定为NULL
+	template <typename... Args>
+	int Bind(Args &&...args)
+	{
+		int ret = SQLITE_OK;
+		int pos = 1;
+		((ret = (ret == SQLITE_OK ? BindArg(pos++, std::forward<Args>(args)) : ret)), ...);
+		(void)pos;
+
+		return ret;
+	}
+
+	// 清空batch后连续Step，把最多batch.Capacity()行按列追加到batch中，返回读到的行数，没有更多行时返回0
+	// 已经返回过SQLITE_DONE的语句不会再Step(否则SQLite会自动重置并从头执行)，需要重新执行时先ResetStmt
+	// 内存不足时停止，Status()返回SQLITE_NOMEM，没有追加的行留作语句的当前行，下次调用先读这一行，不会丢行；
+	// 读取列时内存不足的语句会被SQLite中止，读完这一行之后的Step返回SQLITE_NOMEM，需要ResetStmt后重新执行
+	size_t FetchBatch(SQLite3ColumnBatch &batch)
+	{
+		batch.Clear();
+		while (batch.Size() < batch.Capacity() && stmt_)
+		{
+			if (is_row_pending_)
+			{
+				is_row_pending_ = false;
+				status_ = SQLITE_ROW;
+			}
+			else if (status_ == SQLITE_DONE || Step() != SQLITE_ROW)
+			{
+				break;
+			}
+
+			if (batch.AppendRow(stmt_) != SQLITE_OK)
+			{
+				status_ = SQLITE_NOMEM;
+				is_row_pending_ = true;
+				break;
+			}
+		}
+
+		return batch.Size();
+	}
+
 	int GetColumnBytes(int pos)
 	{
 		int ret = 0;
@@ -274,14 +641,31 @@ public:
 
 	int Step()
 	{
+		is_row_pending_ = false;
 		return status_ = sqlite3_step(stmt_);
 	}
 
 	int ResetStmt()
 	{
+		is_row_pending_ = false;
 		return status_ = sqlite3_reset(stmt_);
 	}
 
+	int ClearBindings()
+	{
+		int ret = 0;
+		if (stmt_)
+			ret = sqlite3_clear_bindings(stmt_);
+		owned_params_.reset();
+
+		return ret;
+	}
+
+	const std::string &GetSql() const
+	{
+		return sql_;
+	}
+
     int GetErrCode() const
     {
         return sqlite3_errcode(db_);
@@ -293,6 +677,92 @@ public:
     }
 
 private:
+	// SQLite的析构回调只能拿到数据指针，找不回std::string/std::vector本身，所以转移进来的参数由语句自己保存
+	// 两个数组按参数个数一次性分配好，之后不再扩容，元素的地址在语句移动时也保持不变
+	struct OwnedParams
+	{
+		std::vector<std::string> texts;
+		std::vector<std::vector<unsigned char>> blobs;
+	};
+
+	template <typename T>
+	int BindArg(int pos, T &&arg)
+	{
+		typedef typename std::decay<T>::type Type;
+		if constexpr (std::is_same<Type, std::nullptr_t>::value || std::is_same<Type, std::nullopt_t>::value)
+		{
+			return BindNull(pos);
+		}
+		else if constexpr (SQLite3IsOptional<Type>::value)
+		{
+			return arg ? BindArg(pos, *std::forward<T>(arg)) : BindNull(pos);
+		}
+		else if constexpr (std::is_integral<Type>::value)
+		{
+			if constexpr (sizeof(Type) < sizeof(int) || (sizeof(Type) == sizeof(int) && std::is_signed<Type>::value))
+				return BindInt(pos, (int)arg);
+			else
+				return BindInt64(pos, (int64_t)arg);
+		}
+		else if constexpr (std::is_floating_point<Type>::value)
+		{
+			return BindDouble(pos, (double)arg);
+		}
+		else if constexpr (std::is_same<Type, const char *>::value || std::is_same<Type, char *>::value)
+		{
+			// 字符串字面量以数组传入，先转成指针再判空
+			const char *str = arg;
+			return str ? BindText(pos, std::string_view(str), SQLITE_STATIC) : BindNull(pos);
+		}
+		else if constexpr (std::is_same<Type, std::string>::value && !std::is_lvalue_reference<T>::value)
+		{
+			// const的临时对象不能转移，也不能不拷贝直接引用，让SQLite拷贝一份
+			if constexpr (std::is_const<typename std::remove_reference<T>::type>::value)
+				return BindText(pos, std::string_view(arg), SQLITE_TRANSIENT);
+			else
+				return BindText(pos, std::move(arg));
+		}
+		else if constexpr (std::is_same<Type, std::vector<unsigned char>>::value && !std::is_lvalue_reference<T>::value)
+		{
+			if constexpr (std::is_const<typename std::remove_reference<T>::type>::value)
+				return BindBlob(pos, SQLite3ByteSpan(arg), SQLITE_TRANSIENT);
+			else
+				return BindBlob(pos, std::move(arg));
+		}
+		else if constexpr (std::is_convertible<const Type &, std::string_view>::value)
+		{
+			return BindText(pos, std::string_view(arg), SQLITE_STATIC);
+		}
+		else if constexpr (std::is_convertible<const Type &, SQLite3ByteSpan>::value)
+		{
+			return BindBlob(pos, SQLite3ByteSpan(arg), SQLITE_STATIC);
+		}
+		else
+		{
+			static_assert(SQLite3AlwaysFalse<Type>::value, "unsupported bind type");
+		}
+	}
+
+	template <typename T>
+	T *GetOwnedParam(int pos, std::vector<T> OwnedParams::*member)
+	{
+		if (!stmt_)
+			return nullptr;
+
+		int param_num = sqlite3_bind_parameter_count(stmt_);
+		if (pos < 1 || pos > param_num)
+			return nullptr;
+
+		if (!owned_params_)
+		{
+			owned_params_.reset(new OwnedParams);
+			owned_params_->texts.resize(param_num);
+			owned_params_->blobs.resize(param_num);
+		}
+
+		return &((*owned_params_).*member)[pos - 1];
+	}
+
 	void SetNull()
 	{
 		stmt_ = nullptr;
@@ -301,334 +771,1900 @@ private:
 	int status_;
 	sqlite3_stmt *stmt_;
 	sqlite3 *db_;
-	std::chrono::system_clock::time_point open_time_;
+	std::shared_ptr<SQLite3ConnState> conn_state_;
 	std::string sql_;
-
-	//static std::unordered_map<std::pair<sqlite3*, std::chrono::system_clock::time_point>, bool, SQLiteMapHash, SQLiteMapEqual> sqlite_db_close_map;
-	static std::map<std::pair<sqlite3*, std::chrono::system_clock::time_point>, bool> sqlite_db_close_map;
+	std::unique_ptr<OwnedParams> owned_params_;
+	bool is_row_pending_;  // FetchBatch因内存不足没有追加当前行，下次FetchBatch不Step直接读这一行
 };
 
-class SQLite3Wrapper
+// SQLite3Stmt::Rows返回的单遍范围，迭代器前进时执行Step，解引用时按Ts读取当前行
+template <typename... Ts>
+class SQLite3Rows
 {
 public:
-	typedef int(*SQLiteCallback)(void*, int, char**, char**);
+	typedef std::tuple<Ts...> RowType;
 
-	static void SQLiteErrorLog(const SQLite3Wrapper &db_manager)
+	class Iterator
 	{
-		LOGE("SQLite Error : %s\n", sqlite3_errmsg(db_manager.db_));
-	}
+	public:
+		typedef std::input_iterator_tag iterator_category;
+		typedef RowType value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const RowType *pointer;
+		typedef RowType reference;
 
-	static std::string SQLiteErrorMsg(const SQLite3Wrapper& db_manager)
-	{
-		const char* msg_ptr = sqlite3_errmsg(db_manager.db_);
-		std::string ret_msg;
-		if (msg_ptr)
+		Iterator() : stmt_(nullptr) {}
+
+		explicit Iterator(SQLite3Stmt *stmt) : stmt_(stmt)
 		{
-			ret_msg = std::move(std::string(msg_ptr));
+			Next();
 		}
 
-		return ret_msg;
-	}
+		RowType operator*() const
+		{
+			return Read(std::index_sequence_for<Ts...>());
+		}
 
-	static int SQLiteErrorCode(const SQLite3Wrapper& db_manager)
+		Iterator &operator++()
+		{
+			Next();
+			return *this;
+		}
+
+		void operator++(int)
+		{
+			Next();
+		}
+
+		bool operator==(const Iterator &rhs) const
+		{
+			return stmt_ == rhs.stmt_;
+		}
+
+		bool operator!=(const Iterator &rhs) const
+		{
+			return stmt_ != rhs.stmt_;
+		}
+
+	private:
+		void Next()
+		{
+			if (stmt_ && stmt_->Step() != SQLITE_ROW)
+				stmt_ = nullptr;
+		}
+
+		template <size_t... Is>
+		RowType Read(std::index_sequence<Is...>) const
+		{
+			return RowType(stmt_->template GetColumn<Ts>((int)Is)...);
+		}
+
+		SQLite3Stmt *stmt_;
+	};
+
+	explicit SQLite3Rows(SQLite3Stmt *stmt) : stmt_(stmt) {}
+
+	Iterator begin()
 	{
-		return sqlite3_errcode(db_manager.db_);
+		return Iterator(stmt_);
 	}
 
-public:
-    SQLite3Wrapper() : db_(nullptr) {}
-	SQLite3Wrapper(const std::string &db_file_path) : db_(nullptr), db_file_path_(db_file_path) {}
-	SQLite3Wrapper(SQLite3Wrapper &&rhs)
+	Iterator end()
 	{
-		db_ = rhs.db_;
-		db_file_path_ = rhs.db_file_path_;
-		open_time_ = rhs.open_time_;
-		rhs.SetNull();
+		return Iterator();
 	}
 
-	~SQLite3Wrapper()
+private:
+	SQLite3Stmt *stmt_;
+};
+
+// 增量读写一个BLOB，不需要把整个BLOB读进内存；由SQLite3Wrapper::OpenBlob创建
+// 写入不能改变BLOB的长度，需要先用zeroblob()分配好空间；需要在CloseDB之前关闭
+class SQLite3BlobStream
+{
+public:
+	SQLite3BlobStream() : blob_(nullptr), status_(SQLITE_OK), position_(0) {}
+
+	SQLite3BlobStream(sqlite3 *db, const char *db_name, const std::string &table, const std::string &column, int64_t rowid, bool is_writable)
+		: blob_(nullptr), position_(0)
 	{
-		if (db_)
+		status_ = sqlite3_blob_open(db, db_name, table.c_str(), column.c_str(), rowid, is_writable ? 1 : 0, &blob_);
+		if (status_ != SQLITE_OK && blob_)
 		{
-			CloseDB();
+			sqlite3_blob_close(blob_);
+			blob_ = nullptr;
 		}
 	}
 
-	SQLite3Wrapper &operator=(SQLite3Wrapper &&rhs)
+	SQLite3BlobStream(SQLite3BlobStream &&rhs) : blob_(rhs.blob_), status_(rhs.status_), position_(rhs.position_)
+	{
+		rhs.blob_ = nullptr;
+	}
+
+	SQLite3BlobStream &operator=(SQLite3BlobStream &&rhs)
 	{
 		if (&rhs != this)
 		{
-			CloseDB();
-			db_ = rhs.db_;
-			db_file_path_ = rhs.db_file_path_;
-			open_time_ = rhs.open_time_;
-
-			rhs.SetNull();
+			Close();
+			blob_ = rhs.blob_;
+			status_ = rhs.status_;
+			position_ = rhs.position_;
+			rhs.blob_ = nullptr;
 		}
 
 		return *this;
 	}
 
-	int OpenDB()
+	~SQLite3BlobStream()
 	{
-		int ret = 0;
-#ifdef WIN32
-		std::wstring db_fullpathw = Utf8ToUtf16(db_file_path_);
-		ret = sqlite3_open16(db_fullpathw.c_str(), &db_);
-#else
-		ret = sqlite3_open(db_file_path_.c_str(), &db_);
-#endif // WIN32
-		open_time_ = std::chrono::system_clock::now();
-		return ret;
+		Close();
 	}
 
-	int CloseDB()
+	int Close()
 	{
-		int ret_code = 0;
-		if (db_)
+		int ret = 0;
+		if (blob_)
 		{
-#ifdef WIN32
-			int rc = sqlite3_close(db_);
-#else
-			int rc = sqlite3_close_v2(db_);
-#endif // WIN32
-			if (rc == SQLITE_BUSY)
-			{
-				sqlite3_stmt * stmt;
-				while ((stmt = sqlite3_next_stmt(db_, NULL)) != NULL)
-				{
-					sqlite3_finalize(stmt);
-				}
-#ifdef WIN32
-				rc = sqlite3_close(db_);
-#else
-				rc = sqlite3_close_v2(db_);
-#endif // WIN32
-				if (rc != SQLITE_OK)
-				{
-					ret_code = rc;
-				}
-			}
-
-			auto close_flag_it = SQLite3Stmt::sqlite_db_close_map.find({ db_, open_time_ });
-			if (close_flag_it != SQLite3Stmt::sqlite_db_close_map.end())
-			{
-				close_flag_it->second = true;
-			}
+			ret = sqlite3_blob_close(blob_);
+			blob_ = nullptr;
 		}
 
-		if (!ret_code)
-			SetNull();
+		return ret;
+	}
 
-		return ret_code;
+	bool IsOpen() const
+	{
+		return blob_ != nullptr;
 	}
 
-	int Begin()
+	int Status() const
 	{
-		return sqlite3_exec(db_, "BEGIN", NULL, NULL, NULL);
+		return status_;
 	}
 
-	int Commit()
+	int Size() const
 	{
-		return sqlite3_exec(db_, "COMMIT", NULL, NULL, NULL);
+		return blob_ ? sqlite3_blob_bytes(blob_) : 0;
 	}
 
-	int Execute(const std::string &sql, SQLiteCallback callback_func, void *arg, char **err_msg)
+	// 切换到同一表同一列的另一行，比重新打开快；失败后句柄不能再读写，只能Reopen或Close
+	int Reopen(int64_t rowid)
 	{
-		return sqlite3_exec(db_, sql.c_str(), callback_func, arg, err_msg);
+		position_ = 0;
+		if (!blob_)
+			return status_ = SQLITE_MISUSE;
+
+		return status_ = sqlite3_blob_reopen(blob_, rowid);
 	}
 
-	SQLite3Stmt GetDBStmt(const std::string &sql)
+	// 从offset开始读size字节到buffer，越界时返回SQLITE_ERROR
+	int Read(int offset, void *buffer, int size)
 	{
-		SQLite3Stmt stmt(sql);
-		stmt.Prepare(db_, open_time_, nullptr);
+		if (!blob_)
+			return status_ = SQLITE_MISUSE;
 
-		return stmt;
+		return status_ = sqlite3_blob_read(blob_, buffer, size, offset);
 	}
 
-	bool IsOpen() const
+	// 在offset处覆盖写入size字节
+	int Write(int offset, const void *buffer, int size)
 	{
-		return db_ != nullptr;
+		if (!blob_)
+			return status_ = SQLITE_MISUSE;
+
+		return status_ = sqlite3_blob_write(blob_, buffer, size, offset);
 	}
 
-    int GetErrCode() const
-    {
-        return sqlite3_errcode(db_);
-    }
+	// 从当前位置顺序读取最多size字节，read_size为实际读到的字节数，读到末尾时为0
+	int ReadNext(void *buffer, int size, int *read_size)
+	{
+		int read_num = std::max(0, std::min(size, Size() - position_));
+		*read_size = 0;
+		if (read_num == 0)
+			return status_ = (blob_ ? SQLITE_OK : SQLITE_MISUSE);
 
-    std::string GetErrMsg() const
-    {
-        return sqlite3_errmsg(db_);
-    }
+		if (Read(position_, buffer, read_num) == SQLITE_OK)
+		{
+			position_ += read_num;
+			*read_size = read_num;
+		}
 
-	//int Finalize()
-	//{
-	//	int ret = 0;
-	//	if (stmt_)
-	//	{
-	//		ret = sqlite3_finalize(stmt_);
-	//		stmt_ = nullptr;
-	//	}
+		return status_;
+	}
 
-	//	return ret;
-	//}
+	int GetPosition() const
+	{
+		return position_;
+	}
 
-	//int Prepare(const std::string &sql, const char **pzTail)
-	//{
-	//	return sqlite3_prepare_v2(db_, sql.data(), (int)sql.size(), &stmt_, pzTail);
-	//}
+	void Seek(int position)
+	{
+		position_ = position;
+	}
 
-	//int BindInt(int pos, int val)
-	//{
-	//	int ret = 0;
-	//	if (stmt_)
-	//		ret = sqlite3_bind_int(stmt_, pos, val);
+private:
+	sqlite3_blob *blob_;
+	int status_;
+	int position_;
+};
 
-	//	return ret;
-	//}
+// 打开连接时的选项，由OpenDB(const SQLite3OpenOptions &)在打开后依次执行对应的PRAGMA
+// 字符串为空、数值为0(mmap_size为-1)表示保持SQLite的默认值
+struct SQLite3OpenOptions
+{
+	int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+	int page_size = 0;                // 只对新建的数据库有效，需要在切换到WAL之前设置
+	std::string journal_mode;         // DELETE/TRUNCATE/PERSIST/MEMORY/WAL/OFF
+	std::string synchronous;          // OFF/NORMAL/FULL/EXTRA
+	std::string locking_mode;         // NORMAL/EXCLUSIVE
+	std::string temp_store;           // DEFAULT/FILE/MEMORY
+	int cache_size = 0;               // 正数为页数，负数为KiB
+	int64_t mmap_size = -1;           // 字节
+	int busy_timeout_ms = 0;
+
+	// 单线程大批量导入: 不落盘同步，回滚日志放在内存中，独占文件锁
+	static SQLite3OpenOptions BulkLoad()
+	{
+		SQLite3OpenOptions options;
+		options.flags |= SQLITE_OPEN_NOMUTEX;
+		options.page_size = 16384;
+		options.journal_mode = "MEMORY";
+		options.synchronous = "OFF";
+		options.locking_mode = "EXCLUSIVE";
+		options.temp_store = "MEMORY";
+		options.cache_size = -256 * 1024;
+		return options;
+	}
 
-	//int BindInt64(int pos, int64_t val)
-	//{
-	//	int ret = 0;
-	//	if (stmt_)
-	//		ret = sqlite3_bind_int64(stmt_, pos, val);
+	// 以查询为主: WAL模式下读不阻塞写，较大的页缓存和mmap减少read系统调用
+	static SQLite3OpenOptions ReadHeavy(bool is_read_only = false)
+	{
+		SQLite3OpenOptions options;
+		options.flags = (is_read_only ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE) | SQLITE_OPEN_NOMUTEX;
+		if (!is_read_only)
+			options.journal_mode = "WAL";
+		options.synchronous = "NORMAL";
+		options.temp_store = "MEMORY";
+		options.cache_size = -64 * 1024;
+		options.mmap_size = 256LL * 1024 * 1024;
+		options.busy_timeout_ms = 5000;
+		return options;
+	}
 
-	//	return ret;
-	//}
+	// 每次提交都同步到磁盘，断电后已提交的事务不会丢失
+	static SQLite3OpenOptions Durable()
+	{
+		SQLite3OpenOptions options;
+		options.journal_mode = "WAL";
+		options.synchronous = "FULL";
+		options.busy_timeout_ms = 5000;
+		return options;
+	}
+};
 
-	//int BindDouble(int pos, double val)
-	//{
-	//	int ret = 0;
-	//	if (stmt_)
-	//		ret = sqlite3_bind_double(stmt_, pos, val);
+// 按SQL统计执行情况，基于sqlite3_trace_v2和sqlite3_stmt_status
+// SQLITE_TRACE_PROFILE给出的耗时精度只有毫秒，这里在SQLITE_TRACE_STMT(语句开始执行)时用steady_clock计时
+// 只有SQLite3Wrapper::EnableProfile之后才会注册回调，没有开启时没有任何额外开销
+// SQL中的字符串和数字常量替换为?，空白合并为一个空格，同一类语句合并统计
+class SQLite3Profiler
+{
+public:
+	static constexpr int kBucketNum = 64;
+	static constexpr size_t kMaxRawSqlNum = 4096;  // 原始SQL缓存的上限，超过后清空重建
 
-	//	return ret;
-	//}
+	struct SqlStat
+	{
+		uint64_t call_num = 0;
+		uint64_t total_ns = 0;
+		uint64_t max_ns = 0;
+		uint64_t row_num = 0;
+		uint64_t fullscan_step_num = 0;
+		uint64_t sort_num = 0;
+		uint64_t autoindex_num = 0;
+		uint64_t vm_step_num = 0;
+		uint64_t buckets[kBucketNum] = {};  // 第i个桶统计耗时在[2^(i-1), 2^i)纳秒内的执行次数
+
+		// 返回所在桶的上界(不超过最大耗时)，单位纳秒
+		uint64_t Percentile(double p) const
+		{
+			uint64_t target = (uint64_t)(p * call_num);
+			uint64_t count = 0;
+			for (int i = 0; i < kBucketNum; ++i)
+			{
+				count += buckets[i];
+				if (count > target || (count == call_num && count > 0))
+					return std::min<uint64_t>(max_ns, i == 0 ? 1 : (i >= 63 ? UINT64_MAX : (1ULL << i)));
+			}
 
-	//int BindText(int pos, const std::string &str, void(*destructor_type)(void*))
-	//{
-	//	int ret = 0;
-	//	if (stmt_)
-	//		ret = sqlite3_bind_text(stmt_, pos, str.c_str(), str.size(), destructor_type);
+			return 0;
+		}
+	};
 
-	//	return ret;
-	//}
+	// slow_threshold_ms小于0时不记录慢查询
+	explicit SQLite3Profiler(int64_t slow_threshold_ms) : slow_threshold_ns_(slow_threshold_ms < 0 ? -1 : slow_threshold_ms * 1000000) {}
 
-	//int BindBlob(int pos, const std::vector<unsigned char> blob_data, void(*destructor_type)(void*))
-	//{
-	//	int ret = 0;
-	//	if (stmt_)
-	//		ret = sqlite3_bind_blob(stmt_, pos, blob_data.data(), blob_data.size(), destructor_type);
+	static int TraceCallback(unsigned type, void *ctx, void *p, void *x)
+	{
+		SQLite3Profiler *profiler = (SQLite3Profiler *)ctx;
+		sqlite3_stmt *stmt = (sqlite3_stmt *)p;
+		if (type == SQLITE_TRACE_STMT)
+			profiler->OnStart(stmt);
+		else if (type == SQLITE_TRACE_ROW)
+			profiler->OnRow(stmt);
+		else if (type == SQLITE_TRACE_PROFILE)
+			profiler->OnProfile(stmt, *(sqlite3_int64 *)x);
+
+		return 0;
+	}
 
-	//	return ret;
-	//}
+	// 按总耗时从大到小排列
+	util::json::json ToJson() const
+	{
+		std::vector<std::pair<std::string, SqlStat>> stats;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stats.assign(stats_.begin(), stats_.end());
+		}
+		std::sort(stats.begin(), stats.end(), [](const std::pair<std::string, SqlStat> &lhs, const std::pair<std::string, SqlStat> &rhs) {
+			return lhs.second.total_ns > rhs.second.total_ns;
+		});
 
-	//int GetColumnInt(int pos)
-	//{
-	//	int ret = 0;
-	//	if (stmt_)
-	//		ret = sqlite3_column_int(stmt_, pos);
+		util::json::json result = util::json::json::array();
+		for (const auto &stat : stats)
+		{
+			const SqlStat &s = stat.second;
+			if (s.call_num == 0)
+				continue;
+
+			result.push_back({
+				{ "sql", stat.first },
+				{ "calls", s.call_num },
+				{ "total_ms", s.total_ns / 1e6 },
+				{ "p50_ms", s.Percentile(0.5) / 1e6 },
+				{ "p99_ms", s.Percentile(0.99) / 1e6 },
+				{ "max_ms", s.max_ns / 1e6 },
+				{ "rows", s.row_num },
+				{ "fullscan_steps", s.fullscan_step_num },
+				{ "sorts", s.sort_num },
+				{ "autoindexes", s.autoindex_num },
+				{ "vm_steps", s.vm_step_num }
+			});
+		}
 
-	//	return ret;
-	//}
+		return result;
+	}
 
-	//int64_t GetColumnInt64(int pos)
-	//{
-	//	int ret = 0;
-	//	if (stmt_)
-	//		ret = sqlite3_column_int64(stmt_, pos);
+	// 只清零统计值，已经出现过的SQL保留在表中(回调中缓存了统计项的指针)，ToJson不输出没有执行过的SQL
+	void Reset()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto &stat : stats_)
+			stat.second = SqlStat();
+	}
 
-	//	return ret;
-	//}
+	static std::string NormalizeSql(const char *sql)
+	{
+		std::string result;
+		bool is_space = false;
+		for (const char *c = sql; *c; ++c)
+		{
+			if (isspace((unsigned char)*c))
+			{
+				is_space = true;
+				continue;
+			}
 
-	//double GetColumnDouble(int pos)
-	//{
-	//	double ret = 0;
-	//	if (stmt_)
-	//		ret = sqlite3_column_double(stmt_, pos);
+			if (is_space && !result.empty())
+				result += ' ';
+			is_space = false;
 
-	//	return ret;
-	//}
+			if (*c == '\'')
+			{
+				for (++c; *c && !(c[0] == '\'' && c[1] != '\''); c += (c[0] == '\'' ? 2 : 1))
+				{
+				}
+				if (!*c)
+					--c;
+				result += '?';
+			}
+			else if (isdigit((unsigned char)*c) && (result.empty() || !(isalnum((unsigned char)result.back()) || strchr("_?:@$", result.back()))))
+			{
+				while (isalnum((unsigned char)c[1]) || c[1] == '.')
+					++c;
+				result += '?';
+			}
+			else
+			{
+				result += *c;
+			}
+		}
 
-	//std::string GetColumnText(int pos)
-	//{
-	//	if (stmt_)
-	//	{
-	//		const char *str = (const char *)sqlite3_column_text(stmt_, pos);
-	//		if (str)
-	//		{
-	//			return str;
-	//		}
-	//	}
+		return result;
+	}
 
-	//	return "";
-	//}
+private:
+	// 每个sqlite3_stmt对应的记录，只在回调中访问；同一连接上的回调不会并发执行，因此不加锁
+	// stat指向stats_中的统计项，Reset只清零统计项不删除，指针一直有效
+	struct StmtRecord
+	{
+		std::string raw_sql;
+		SqlStat *stat = nullptr;
+		std::chrono::steady_clock::time_point start_time;
+		uint64_t row_num = 0;
+		bool is_running = false;
+	};
+
+	// 语句finalize之后地址可能被新语句复用，SQL文本不同时重新查找统计项；只有这时才加锁和构造字符串
+	StmtRecord &GetRecord(sqlite3_stmt *stmt)
+	{
+		StmtRecord &record = records_[stmt];
+		const char *raw_sql = sqlite3_sql(stmt);
+		if (!raw_sql)
+			raw_sql = "";
+		if (!record.stat || record.raw_sql != raw_sql)
+		{
+			record.raw_sql = raw_sql;
+			record.is_running = false;
+			std::lock_guard<std::mutex> lock(mutex_);
+			// 拼接了字面量的SQL每次文本都不同，缓存会无限增长；清空只丢掉缓存，统计项仍在stats_中，已有记录的指针不受影响
+			if (raw_sql_stats_.size() >= kMaxRawSqlNum)
+				raw_sql_stats_.clear();
+			SqlStat *&stat_ptr = raw_sql_stats_[record.raw_sql];
+			if (!stat_ptr)
+				stat_ptr = &stats_[NormalizeSql(raw_sql)];
+			record.stat = stat_ptr;
+		}
+		last_stmt_ = stmt;
+		last_record_ = &record;
 
-	//std::vector<unsigned char> GetColumnBlob(int pos)
-	//{
-	//	if (stmt_)
-	//	{
-	//		const unsigned char *byte_ptr = (const unsigned char *)sqlite3_column_blob(stmt_, pos);
-	//		int byte_len = sqlite3_column_bytes(stmt_, pos);
+		return record;
+	}
 
-	//		return std::vector<unsigned char>(byte_ptr, byte_ptr + byte_len);
-	//	}
+	// 触发器中的子语句也会产生SQLITE_TRACE_STMT事件，只保留最外层语句的开始时间
+	void OnStart(sqlite3_stmt *stmt)
+	{
+		StmtRecord &record = GetRecord(stmt);
+		if (record.is_running)
+			return;
 
-	//	return {};
-	//}
+		record.is_running = true;
+		record.start_time = std::chrono::steady_clock::now();
+		record.row_num = 0;
+	}
 
-	//int GetColumnBytes(int pos)
-	//{
-	//	int ret = 0;
-	//	if (stmt_)
-	//	{
-	//		ret = sqlite3_column_bytes(stmt_, pos);
-	//	}
+	// 每返回一行调用一次，连续的行通常来自同一条语句，直接使用上一次查到的记录
+	void OnRow(sqlite3_stmt *stmt)
+	{
+		if (stmt != last_stmt_)
+		{
+			auto record_it = records_.find(stmt);
+			if (record_it == records_.end())
+				return;
+			last_stmt_ = stmt;
+			last_record_ = &record_it->second;
+		}
+		++last_record_->row_num;
+	}
 
-	//	return ret;
-	//}
+	void OnProfile(sqlite3_stmt *stmt, sqlite3_int64 elapsed_ns)
+	{
+		auto now = std::chrono::steady_clock::now();
+		StmtRecord &record = stmt == last_stmt_ ? *last_record_ : GetRecord(stmt);
+		uint64_t row_num = 0;
+		if (record.is_running)
+		{
+			elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - record.start_time).count();
+			row_num = record.row_num;
+			record.is_running = false;
+		}
 
-	//int GetColumnCount()
-	//{
-	//	int ret = 0;
-	//	if (stmt_)
-	//	{
-	//		ret = sqlite3_column_count(stmt_);
-	//	}
+		uint64_t ns = elapsed_ns > 0 ? (uint64_t)elapsed_ns : 0;
+		int bucket = 0;
+		while (bucket < kBucketNum - 1 && (ns >> bucket) > 0)
+			++bucket;
 
-	//	return ret;
-	//}
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			SqlStat &stat = *record.stat;
+			++stat.call_num;
+			stat.total_ns += ns;
+			stat.max_ns = std::max(stat.max_ns, ns);
+			++stat.buckets[bucket];
+			stat.fullscan_step_num += sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+			stat.sort_num += sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+			stat.autoindex_num += sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+			stat.vm_step_num += sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+			stat.row_num += row_num;
+		}
 
-	//int GetColumnType(int pos)
-	//{
-	//	int ret = 0;
-	//	if (stmt_)
-	//	{
-	//		ret = sqlite3_column_type(stmt_, pos);
-	//	}
+		if (slow_threshold_ns_ >= 0 && (int64_t)ns >= slow_threshold_ns_)
+			spdlog::warn("slow sql {:.3f} ms: {}", ns / 1e6, record.raw_sql);
+	}
+
+	int64_t slow_threshold_ns_;
+	mutable std::mutex mutex_;
+	std::unordered_map<std::string, SqlStat> stats_;
+	std::unordered_map<std::string, SqlStat *> raw_sql_stats_;  // 原始SQL到归一化后统计项的缓存，避免每次都做归一化
+	std::unordered_map<sqlite3_stmt *, StmtRecord> records_;
+	sqlite3_stmt *last_stmt_ = nullptr;
+	StmtRecord *last_record_ = nullptr;
+};
+
+// 单个连接上按SQL文本缓存的预编译语句，按LRU淘汰
+// 借出中的语句不会被淘汰；同一条SQL同时被借出多次时，多出来的语句单独编译，归还时直接finalize
+class SQLite3StmtCache
+{
+public:
+	explicit SQLite3StmtCache(size_t capacity) : capacity_(capacity), hit_count_(0), miss_count_(0)
+	{
+
+	}
+
+	std::shared_ptr<SQLite3Stmt> Acquire(sqlite3 *db, const std::shared_ptr<SQLite3ConnState> &conn_state, const std::string &sql)
+	{
+		auto index_it = index_.find(sql);
+		if (index_it != index_.end() && !index_it->second->is_in_use)
+		{
+			++hit_count_;
+			entries_.splice(entries_.begin(), entries_, index_it->second);
+			index_it->second->is_in_use = true;
+			return index_it->second->stmt;
+		}
+
+		++miss_count_;
+		auto stmt = std::make_shared<SQLite3Stmt>(sql);
+		stmt->Prepare(db, conn_state, nullptr);
+		if (stmt->Status() != SQLITE_OK || index_it != index_.end() || capacity_ == 0)
+			return stmt;
+
+		entries_.push_front({ sql, stmt, true });
+		index_[sql] = entries_.begin();
+		Evict();
+		return stmt;
+	}
+
+	// 归还时重置语句并清空绑定的参数，下次借出时可以直接使用
+	void Release(const std::shared_ptr<SQLite3Stmt> &stmt)
+	{
+		auto index_it = index_.find(stmt->GetSql());
+		if (index_it == index_.end() || index_it->second->stmt != stmt)
+			return;
+
+		stmt->ResetStmt();
+		stmt->ClearBindings();
+		index_it->second->is_in_use = false;
+		Evict();
+	}
+
+	// 丢弃所有缓存的语句，没有借出的语句立即finalize，借出中的语句在归还时finalize
+	void Clear()
+	{
+		index_.clear();
+		entries_.clear();
+	}
+
+	void SetCapacity(size_t capacity)
+	{
+		capacity_ = capacity;
+		Evict();
+	}
+
+	size_t Size() const
+	{
+		return entries_.size();
+	}
+
+	uint64_t HitCount() const
+	{
+		return hit_count_;
+	}
+
+	uint64_t MissCount() const
+	{
+		return miss_count_;
+	}
+
+private:
+	struct Entry
+	{
+		std::string sql;
+		std::shared_ptr<SQLite3Stmt> stmt;
+		bool is_in_use;
+	};
+
+	// 从最久没有使用的一端开始淘汰没有借出的语句
+	void Evict()
+	{
+		auto it = entries_.end();
+		while (entries_.size() > capacity_ && it != entries_.begin())
+		{
+			--it;
+			if (!it->is_in_use)
+			{
+				index_.erase(it->sql);
+				it = entries_.erase(it);
+			}
+		}
+	}
+
+	size_t capacity_;
+	std::list<Entry> entries_;
+	std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+	uint64_t hit_count_;
+	uint64_t miss_count_;
+};
+
+// 从SQLite3StmtCache借出的语句，析构时归还；连接已经关闭或缓存已被清空时直接finalize
+class SQLite3StmtLease
+{
+public:
+	SQLite3StmtLease() {}
+
+	SQLite3StmtLease(std::weak_ptr<SQLite3StmtCache> cache, std::shared_ptr<SQLite3Stmt> stmt)
+		: cache_(std::move(cache)), stmt_(std::move(stmt))
+	{
+
+	}
+
+	SQLite3StmtLease(SQLite3StmtLease &&rhs) = default;
+
+	SQLite3StmtLease &operator=(SQLite3StmtLease &&rhs)
+	{
+		if (&rhs != this)
+		{
+			Release();
+			cache_ = std::move(rhs.cache_);
+			stmt_ = std::move(rhs.stmt_);
+		}
+
+		return *this;
+	}
+
+	~SQLite3StmtLease()
+	{
+		Release();
+	}
+
+	SQLite3Stmt *operator->() const
+	{
+		return stmt_.get();
+	}
+
+	SQLite3Stmt &operator*() const
+	{
+		return *stmt_;
+	}
+
+	explicit operator bool() const
+	{
+		return stmt_ != nullptr;
+	}
+
+	void Release()
+	{
+		if (stmt_)
+		{
+			if (auto cache = cache_.lock())
+				cache->Release(stmt_);
+			stmt_.reset();
+		}
+	}
+
+private:
+	std::weak_ptr<SQLite3StmtCache> cache_;
+	std::shared_ptr<SQLite3Stmt> stmt_;
+};
+
+class SQLite3Wrapper
+{
+	friend class SQLite3BulkWriter;
+public:
+	typedef int(*SQLiteCallback)(void*, int, char**, char**);
+
+	static void SQLiteErrorLog(const SQLite3Wrapper &db_manager)
+	{
+		LOGE("SQLite Error : %s\n", sqlite3_errmsg(db_manager.db_));
+	}
+
+	static std::string SQLiteErrorMsg(const SQLite3Wrapper& db_manager)
+	{
+		const char* msg_ptr = sqlite3_errmsg(db_manager.db_);
+		std::string ret_msg;
+		if (msg_ptr)
+		{
+			ret_msg = std::move(std::string(msg_ptr));
+		}
+
+		return ret_msg;
+	}
+
+	static int SQLiteErrorCode(const SQLite3Wrapper& db_manager)
+	{
+		return sqlite3_errcode(db_manager.db_);
+	}
+
+public:
+	static constexpr size_t kDefaultStmtCacheCapacity = 32;
+	static constexpr std::chrono::milliseconds kSnapshotMaxBackoff = std::chrono::milliseconds(100);
+
+    SQLite3Wrapper() : db_(nullptr), stmt_cache_(std::make_shared<SQLite3StmtCache>(kDefaultStmtCacheCapacity)) {}
+	SQLite3Wrapper(const std::string &db_file_path) : db_(nullptr), db_file_path_(db_file_path), stmt_cache_(std::make_shared<SQLite3StmtCache>(kDefaultStmtCacheCapacity)) {}
+	SQLite3Wrapper(SQLite3Wrapper &&rhs)
+	{
+		db_ = rhs.db_;
+		db_file_path_ = rhs.db_file_path_;
+		conn_state_ = std::move(rhs.conn_state_);
+		stmt_cache_ = std::move(rhs.stmt_cache_);
+		profiler_ = std::move(rhs.profiler_);
+		rhs.stmt_cache_ = std::make_shared<SQLite3StmtCache>(kDefaultStmtCacheCapacity);
+		rhs.SetNull();
+	}
+
+	~SQLite3Wrapper()
+	{
+		if (db_)
+		{
+			CloseDB();
+		}
+	}
+
+	SQLite3Wrapper &operator=(SQLite3Wrapper &&rhs)
+	{
+		if (&rhs != this)
+		{
+			CloseDB();
+			db_ = rhs.db_;
+			db_file_path_ = rhs.db_file_path_;
+			conn_state_ = std::move(rhs.conn_state_);
+			stmt_cache_.swap(rhs.stmt_cache_);
+			profiler_ = std::move(rhs.profiler_);
+
+			rhs.SetNull();
+		}
+
+		return *this;
+	}
+
+	int OpenDB()
+	{
+		int ret = 0;
+#ifdef WIN32
+		std::wstring db_fullpathw = Utf8ToUtf16(db_file_path_);
+		ret = sqlite3_open16(db_fullpathw.c_str(), &db_);
+#else
+		ret = sqlite3_open(db_file_path_.c_str(), &db_);
+#endif // WIN32
+		conn_state_ = std::make_shared<SQLite3ConnState>();
+		return ret;
+	}
+
+	// flags为SQLITE_OPEN_*的组合，如只读连接使用SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX
+	// sqlite3_open_v2的文件名在所有平台上都是UTF-8编码
+	int OpenDB(int flags)
+	{
+		int ret = sqlite3_open_v2(db_file_path_.c_str(), &db_, flags, nullptr);
+		conn_state_ = std::make_shared<SQLite3ConnState>();
+		return ret;
+	}
+
+	// 打开连接并应用options中的设置，任何一项失败都会关闭连接并返回错误码，不会留下只配置了一部分的连接
+	int OpenDB(const SQLite3OpenOptions &options)
+	{
+		int ret = OpenDB(options.flags);
+		if (ret == SQLITE_OK && options.busy_timeout_ms > 0)
+			ret = SetBusyTimeout(options.busy_timeout_ms);
+
+		std::vector<std::string> pragmas;
+		if (options.page_size > 0)
+			pragmas.push_back("PRAGMA page_size=" + std::to_string(options.page_size));
+		if (!options.locking_mode.empty())
+			pragmas.push_back("PRAGMA locking_mode=" + options.locking_mode);
+		if (!options.journal_mode.empty())
+			pragmas.push_back("PRAGMA journal_mode=" + options.journal_mode);
+		if (!options.synchronous.empty())
+			pragmas.push_back("PRAGMA synchronous=" + options.synchronous);
+		if (!options.temp_store.empty())
+			pragmas.push_back("PRAGMA temp_store=" + options.temp_store);
+		if (options.cache_size != 0)
+			pragmas.push_back("PRAGMA cache_size=" + std::to_string(options.cache_size));
+		if (options.mmap_size >= 0)
+			pragmas.push_back("PRAGMA mmap_size=" + std::to_string(options.mmap_size));
+
+		for (size_t i = 0; i < pragmas.size() && ret == SQLITE_OK; ++i)
+			ret = Execute(pragmas[i], NULL, NULL, NULL);
+
+		if (ret != SQLITE_OK && db_)
+		{
+			LOGE("open sqlite db %s failed : %s\n", db_file_path_.c_str(), GetErrMsg().c_str());
+			CloseDB();
+			SetNull();
+		}
+
+		return ret;
+	}
+
+	int SetBusyTimeout(int ms)
+	{
+		return sqlite3_busy_timeout(db_, ms);
+	}
+
+	int CloseDB()
+	{
+		int ret_code = 0;
+		if (db_)
+		{
+			// 缓存的语句要在关闭连接之前finalize
+			stmt_cache_->Clear();
+			if (profiler_)
+				sqlite3_trace_v2(db_, 0, NULL, NULL);
+#ifdef WIN32
+			int rc = sqlite3_close(db_);
+#else
+			int rc = sqlite3_close_v2(db_);
+#endif // WIN32
+			if (rc == SQLITE_BUSY)
+			{
+				sqlite3_stmt * stmt;
+				while ((stmt = sqlite3_next_stmt(db_, NULL)) != NULL)
+				{
+					sqlite3_finalize(stmt);
+				}
+				conn_state_->is_stmt_finalized.store(true, std::memory_order_release);
+#ifdef WIN32
+				rc = sqlite3_close(db_);
+#else
+				rc = sqlite3_close_v2(db_);
+#endif // WIN32
+				if (rc != SQLITE_OK)
+				{
+					ret_code = rc;
+				}
+			}
+		}
+
+		if (!ret_code)
+			SetNull();
+
+		return ret_code;
+	}
+
+	int Begin()
+	{
+		return sqlite3_exec(db_, "BEGIN", NULL, NULL, NULL);
+	}
+
+	int Commit()
+	{
+		return sqlite3_exec(db_, "COMMIT", NULL, NULL, NULL);
+	}
+
+	int Execute(const std::string &sql, SQLiteCallback callback_func, void *arg, char **err_msg)
+	{
+		return sqlite3_exec(db_, sql.c_str(), callback_func, arg, err_msg);
+	}
+
+	SQLite3Stmt GetDBStmt(const std::string &sql)
+	{
+		SQLite3Stmt stmt(sql);
+		stmt.Prepare(db_, conn_state_, nullptr);
+
+		return stmt;
+	}
+
+	// 从语句缓存中借出sql对应的语句，缓存中没有时编译后放入缓存；借出的语句已经重置并清空了绑定参数
+	// 返回的SQLite3StmtLease需要在CloseDB之前释放
+	SQLite3StmtLease GetCachedStmt(const std::string &sql)
+	{
+		return SQLite3StmtLease(stmt_cache_, stmt_cache_->Acquire(db_, conn_state_, sql));
+	}
+
+	// 返回false时中止备份；remaining_pages和total_pages来自sqlite3_backup_remaining/pagecount
+	typedef std::function<bool(int remaining_pages, int total_pages)> SnapshotProgress;
+
+	// 把main库在线备份到dest_path，每次复制pages_per_step页，两次之间休眠step_interval让出锁
+	// WAL模式下整个备份在同一个读事务中进行，其它连接的写入不会阻塞也不会导致备份重新开始，得到的是开始时刻的快照；
+	// 其它日志模式下每一步结束后释放读锁，期间有其它连接写入时SQLite会从头重新复制
+	// 这个连接本身在备份期间不能用于写入，建议在单独的只读连接上调用
+	// 源库被锁(SQLITE_BUSY/SQLITE_LOCKED)时从1ms开始加倍退避，最长每次kSnapshotMaxBackoff；
+	// 连续被锁超过busy_timeout时放弃并返回SQLITE_BUSY
+	int Snapshot(const std::string &dest_path, int pages_per_step = 256, const SnapshotProgress &progress = nullptr,
+		std::chrono::milliseconds step_interval = std::chrono::milliseconds(1), std::chrono::milliseconds busy_timeout = std::chrono::seconds(30))
+	{
+		if (!db_)
+			return SQLITE_MISUSE;
+
+		bool is_pinned = false;
+		if (sqlite3_get_autocommit(db_))
+		{
+			SQLite3Stmt journal_stmt = GetDBStmt("PRAGMA journal_mode");
+			if (journal_stmt.Step() == SQLITE_ROW && journal_stmt.GetColumnTextView(0) == "wal" && Begin() == SQLITE_OK)
+			{
+				// BEGIN是延迟事务，读一次才真正开始读事务；读失败时回滚，不把连接留在事务中
+				is_pinned = Execute("SELECT count(*) FROM sqlite_master", NULL, NULL, NULL) == SQLITE_OK;
+				if (!is_pinned)
+					Execute("ROLLBACK", NULL, NULL, NULL);
+			}
+		}
+
+		sqlite3 *dest_db = nullptr;
+		int ret = sqlite3_open_v2(dest_path.c_str(), &dest_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
+		sqlite3_backup *backup = nullptr;
+		if (ret == SQLITE_OK)
+		{
+			backup = sqlite3_backup_init(dest_db, "main", db_, "main");
+			if (!backup)
+				ret = sqlite3_errcode(dest_db);
+		}
+
+		std::chrono::milliseconds backoff(0);
+		std::chrono::steady_clock::time_point busy_start;
+		while (backup)
+		{
+			ret = sqlite3_backup_step(backup, pages_per_step > 0 ? pages_per_step : -1);
+			if (progress && !progress(sqlite3_backup_remaining(backup), sqlite3_backup_pagecount(backup)))
+			{
+				if (ret != SQLITE_DONE)
+					ret = SQLITE_INTERRUPT;
+				break;
+			}
+			if (ret == SQLITE_BUSY || ret == SQLITE_LOCKED)
+			{
+				auto now = std::chrono::steady_clock::now();
+				if (backoff.count() == 0)
+					busy_start = now;
+				else if (now - busy_start >= busy_timeout)
+				{
+					ret = SQLITE_BUSY;
+					break;
+				}
+				backoff = backoff.count() == 0 ? std::chrono::milliseconds(1) : std::min(backoff * 2, kSnapshotMaxBackoff);
+				std::this_thread::sleep_for(std::max(backoff, step_interval));
+				continue;
+			}
+			if (ret != SQLITE_OK)
+				break;
+
+			backoff = std::chrono::milliseconds(0);
+			if (step_interval.count() > 0)
+				std::this_thread::sleep_for(step_interval);
+		}
+
+		if (backup)
+		{
+			int finish_ret = sqlite3_backup_finish(backup);
+			if (ret == SQLITE_DONE)
+				ret = finish_ret;
+		}
+		if (dest_db)
+			sqlite3_close(dest_db);
+		// 只读事务，回滚即可；事务可能已经被SQLite自动回滚，只在仍处于事务中时执行
+		if (is_pinned && !sqlite3_get_autocommit(db_))
+			Execute("ROLLBACK", NULL, NULL, NULL);
+
+		if (ret != SQLITE_OK)
+			LOGE("snapshot sqlite db %s to %s failed : %d\n", db_file_path_.c_str(), dest_path.c_str(), ret);
+
+		return ret;
+	}
+
+	// 打开table.column在rowid行的BLOB，is_writable为false时只读；结果通过返回值的Status()判断
+	SQLite3BlobStream OpenBlob(const std::string &table, const std::string &column, int64_t rowid, bool is_writable, const char *db_name = "main")
+	{
+		return SQLite3BlobStream(db_, db_name, table, column, rowid, is_writable);
+	}
+
+	// 开始按SQL统计执行耗时和语句状态，耗时不少于slow_threshold_ms的语句通过spdlog输出警告，小于0时不输出
+	// 需要在OpenDB之后调用；重复调用会清空之前的统计
+	int EnableProfile(int64_t slow_threshold_ms = -1)
+	{
+		if (!db_)
+			return SQLITE_MISUSE;
+
+		profiler_.reset(new SQLite3Profiler(slow_threshold_ms));
+		return sqlite3_trace_v2(db_, SQLITE_TRACE_STMT | SQLITE_TRACE_PROFILE | SQLITE_TRACE_ROW, &SQLite3Profiler::TraceCallback, profiler_.get());
+	}
+
+	void DisableProfile()
+	{
+		if (db_)
+			sqlite3_trace_v2(db_, 0, NULL, NULL);
+		profiler_.reset();
+	}
+
+	// 每条SQL一项，包含调用次数、总耗时/p50/p99、返回行数、全表扫描步数、排序和自动索引次数
+	util::json::json GetProfileJson() const
+	{
+		return profiler_ ? profiler_->ToJson() : util::json::json::array();
+	}
+
+	void ResetProfile()
+	{
+		if (profiler_)
+			profiler_->Reset();
+	}
+
+	void SetStmtCacheCapacity(size_t capacity)
+	{
+		stmt_cache_->SetCapacity(capacity);
+	}
+
+	uint64_t GetStmtCacheHitCount() const
+	{
+		return stmt_cache_->HitCount();
+	}
+
+	uint64_t GetStmtCacheMissCount() const
+	{
+		return stmt_cache_->MissCount();
+	}
+
+	bool IsOpen() const
+	{
+		return db_ != nullptr;
+	}
+
+    int GetErrCode() const
+    {
+        return sqlite3_errcode(db_);
+    }
+
+    std::string GetErrMsg() const
+    {
+        return sqlite3_errmsg(db_);
+    }
+
+	//int Finalize()
+	//{
+	//	int ret = 0;
+	//	if (stmt_)
+	//	{
+	//		ret = sqlite3_finalize(stmt_);
+	//		stmt_ = nullptr;
+	//	}
+
+	//	return ret;
+	//}
+
+	//int Prepare(const std::string &sql, const char **pzTail)
+	//{
+	//	return sqlite3_prepare_v2(db_, sql.data(), (int)sql.size(), &stmt_, pzTail);
+	//}
+
+	//int BindInt(int pos, int val)
+	//{
+	//	int ret = 0;
+	//	if (stmt_)
+	//		ret = sqlite3_bind_int(stmt_, pos, val);
+
+	//	return ret;
+	//}
+
+	//int BindInt64(int pos, int64_t val)
+	//{
+	//	int ret = 0;
+	//	if (stmt_)
+	//		ret = sqlite3_bind_int64(stmt_, pos, val);
+
+	//	return ret;
+	//}
+
+	//int BindDouble(int pos, double val)
+	//{
+	//	int ret = 0;
+	//	if (stmt_)
+	//		ret = sqlite3_bind_double(stmt_, pos, val);
+
+	//	return ret;
+	//}
+
+	//int BindText(int pos, const std::string &str, void(*destructor_type)(void*))
+	//{
+	//	int ret = 0;
+	//	if (stmt_)
+	//		ret = sqlite3_bind_text(stmt_, pos, str.c_str(), str.size(), destructor_type);
+
+	//	return ret;
+	//}
+
+	//int BindBlob(int pos, const std::vector<unsigned char> blob_data, void(*destructor_type)(void*))
+	//{
+	//	int ret = 0;
+	//	if (stmt_)
+	//		ret = sqlite3_bind_blob(stmt_, pos, blob_data.data(), blob_data.size(), destructor_type);
 
 	//	return ret;
 	//}
 
-	//int Step()
-	//{
-	//	return sqlite3_step(stmt_);
-	//}
+	//int GetColumnInt(int pos)
+	//{
+	//	int ret = 0;
+	//	if (stmt_)
+	//		ret = sqlite3_column_int(stmt_, pos);
+
+	//	return ret;
+	//}
+
+	//int64_t GetColumnInt64(int pos)
+	//{
+	//	int ret = 0;
+	//	if (stmt_)
+	//		ret = sqlite3_column_int64(stmt_, pos);
+
+	//	return ret;
+	//}
+
+	//double GetColumnDouble(int pos)
+	//{
+	//	double ret = 0;
+	//	if (stmt_)
+	//		ret = sqlite3_column_double(stmt_, pos);
+
+	//	return ret;
+	//}
+
+	//std::string GetColumnText(int pos)
+	//{
+	//	if (stmt_)
+	//	{
+	//		const char *str = (const char *)sqlite3_column_text(stmt_, pos);
+	//		if (str)
+	//		{
+	//			return str;
+	//		}
+	//	}
+
+	//	return "";
+	//}
+
+	//std::vector<unsigned char> GetColumnBlob(int pos)
+	//{
+	//	if (stmt_)
+	//	{
+	//		const unsigned char *byte_ptr = (const unsigned char *)sqlite3_column_blob(stmt_, pos);
+	//		int byte_len = sqlite3_column_bytes(stmt_, pos);
+
+	//		return std::vector<unsigned char>(byte_ptr, byte_ptr + byte_len);
+	//	}
+
+	//	return {};
+	//}
+
+	//int GetColumnBytes(int pos)
+	//{
+	//	int ret = 0;
+	//	if (stmt_)
+	//	{
+	//		ret = sqlite3_column_bytes(stmt_, pos);
+	//	}
+
+	//	return ret;
+	//}
+
+	//int GetColumnCount()
+	//{
+	//	int ret = 0;
+	//	if (stmt_)
+	//	{
+	//		ret = sqlite3_column_count(stmt_);
+	//	}
+
+	//	return ret;
+	//}
+
+	//int GetColumnType(int pos)
+	//{
+	//	int ret = 0;
+	//	if (stmt_)
+	//	{
+	//		ret = sqlite3_column_type(stmt_, pos);
+	//	}
+
+	//	return ret;
+	//}
+
+	//int Step()
+	//{
+	//	return sqlite3_step(stmt_);
+	//}
+
+	//int ResetStmt()
+	//{
+	//	return sqlite3_reset(stmt_);
+	//}
+
+private:
+    void SetNull()
+    {
+        db_ = nullptr;
+    }
+
+    sqlite3 *db_;
+    std::shared_ptr<SQLite3ConnState> conn_state_;
+    std::string db_file_path_;
+    std::shared_ptr<SQLite3StmtCache> stmt_cache_;
+    std::unique_ptr<SQLite3Profiler> profiler_;
+};
+
+// 批量写入: 按行缓存要插入的数据，凑满rows_per_stmt行后用一条多行VALUES语句写入，每rows_per_commit行或commit_interval提交一次事务
+// insert_head形如"INSERT INTO t(a, b) VALUES"，insert_tail可以是ON CONFLICT子句，两条语句(整批和单行)在构造时编译并一直复用
+// 提交时间只在Add时检查，没有后台定时器；析构时写入剩余的行并提交
+class SQLite3BulkWriter
+{
+public:
+	static constexpr size_t kDefaultRowsPerCommit = 10000;
+	static constexpr int kMaxRowsPerStmt = 64;
+
+	SQLite3BulkWriter(SQLite3Wrapper &db, const std::string &insert_head, int column_num, const std::string &insert_tail = "")
+		: db_(db), insert_head_(insert_head), insert_tail_(insert_tail), column_num_(column_num > 0 ? column_num : 1),
+		rows_per_stmt_(1), row_num_(0), rows_per_commit_(kDefaultRowsPerCommit), commit_interval_(std::chrono::milliseconds(1000)),
+		uncommitted_row_num_(0), written_row_num_(0), is_in_transaction_(false)
+	{
+		single_stmt_ = db_.GetDBStmt(BuildSql(1));
+		SetRowsPerStmt(kMaxRowsPerStmt);
+	}
+
+	SQLite3BulkWriter(const SQLite3BulkWriter &) = delete;
+	SQLite3BulkWriter &operator=(const SQLite3BulkWriter &) = delete;
+
+	~SQLite3BulkWriter()
+	{
+		Flush();
+	}
+
+	// 设置一条语句写入的行数，会被限制在SQLite参数个数上限之内；为1时不做多行打包
+	int SetRowsPerStmt(int rows_per_stmt)
+	{
+		int ret = WriteRows();
+		int max_rows = db_.db_ ? sqlite3_limit(db_.db_, SQLITE_LIMIT_VARIABLE_NUMBER, -1) / column_num_ : 1;
+		rows_per_stmt_ = std::max(1, std::min(rows_per_stmt, max_rows));
+		values_.resize((size_t)rows_per_stmt_ * column_num_);
+		batch_stmt_ = db_.GetDBStmt(BuildSql(rows_per_stmt_));
+
+		return ret;
+	}
 
-	//int ResetStmt()
-	//{
-	//	return sqlite3_reset(stmt_);
-	//}
+	void SetCommitPolicy(size_t rows_per_commit, std::chrono::milliseconds commit_interval)
+	{
+		rows_per_commit_ = rows_per_commit > 0 ? rows_per_commit : 1;
+		commit_interval_ = commit_interval;
+	}
+
+	// 参数个数必须和column_num一致，支持整数、浮点数、字符串(std::string/std::string_view/const char*)、二进制(std::vector<unsigned char>/SQLite3ByteSpan)和nullptr
+	// 返回SQLite错误码，写入出错时当前缓存的行会被丢弃，事务保持打开，由调用方决定是否回滚
+	template <typename... Args>
+	int Add(const Args &...args)
+	{
+		if ((int)sizeof...(Args) != column_num_)
+			return SQLITE_RANGE;
+
+		int ret = SQLITE_OK;
+		if (!is_in_transaction_)
+		{
+			ret = db_.Begin();
+			if (ret != SQLITE_OK)
+				return ret;
+
+			is_in_transaction_ = true;
+			transaction_start_time_ = std::chrono::steady_clock::now();
+		}
+
+		Value *row = &values_[(size_t)row_num_ * column_num_];
+		int unused[] = { 0, (SetValue(*row++, args), 0)... };
+		(void)unused;
+		++row_num_;
+		++uncommitted_row_num_;
+
+		if (row_num_ == rows_per_stmt_)
+			ret = WriteRows();
+
+		if (ret == SQLITE_OK && (uncommitted_row_num_ >= rows_per_commit_ || std::chrono::steady_clock::now() - transaction_start_time_ >= commit_interval_))
+			ret = Flush();
+
+		return ret;
+	}
+
+	// 写入缓存的行并提交事务
+	int Flush()
+	{
+		int ret = WriteRows();
+		if (is_in_transaction_)
+		{
+			int commit_ret = db_.Commit();
+			if (commit_ret == SQLITE_OK)
+			{
+				is_in_transaction_ = false;
+				uncommitted_row_num_ = 0;
+			}
+			if (ret == SQLITE_OK)
+				ret = commit_ret;
+		}
+
+		return ret;
+	}
+
+	uint64_t GetWrittenRowNum() const
+	{
+		return written_row_num_;
+	}
+
+	int GetRowsPerStmt() const
+	{
+		return rows_per_stmt_;
+	}
 
 private:
-    void SetNull()
-    {
-        db_ = nullptr;
-    }
+	struct Value
+	{
+		int type = SQLITE_NULL;
+		int64_t int_val = 0;
+		double double_val = 0;
+		std::string text_val;
+		std::vector<unsigned char> blob_val;
+	};
+
+	template <typename T>
+	static typename std::enable_if<std::is_integral<T>::value>::type SetValue(Value &value, const T &val)
+	{
+		value.type = SQLITE_INTEGER;
+		value.int_val = (int64_t)val;
+	}
 
-    sqlite3 *db_;
-    std::chrono::system_clock::time_point open_time_;
-    std::string db_file_path_;
+	template <typename T>
+	static typename std::enable_if<std::is_floating_point<T>::value>::type SetValue(Value &value, const T &val)
+	{
+		value.type = SQLITE_FLOAT;
+		value.double_val = val;
+	}
+
+	static void SetValue(Value &value, const std::string &val)
+	{
+		value.type = SQLITE_TEXT;
+		value.text_val.assign(val);
+	}
+
+	static void SetValue(Value &value, const char *val)
+	{
+		value.type = val ? SQLITE_TEXT : SQLITE_NULL;
+		if (val)
+			value.text_val.assign(val);
+	}
+
+	static void SetValue(Value &value, SQLite3ByteSpan val)
+	{
+		value.type = SQLITE_BLOB;
+		value.blob_val.assign(val.begin(), val.end());
+	}
+
+	static void SetValue(Value &value, std::string_view val)
+	{
+		value.type = SQLITE_TEXT;
+		value.text_val.assign(val.data(), val.size());
+	}
+
+	static void SetValue(Value &value, std::nullptr_t)
+	{
+		value.type = SQLITE_NULL;
+	}
+
+	std::string BuildSql(int row_num) const
+	{
+		std::string row = "(";
+		for (int i = 0; i < column_num_; ++i)
+			row += i ? ", ?" : "?";
+		row += ")";
+
+		std::string sql = insert_head_;
+		for (int i = 0; i < row_num; ++i)
+		{
+			sql += i ? ", " : " ";
+			sql += row;
+		}
+		if (!insert_tail_.empty())
+			sql += " " + insert_tail_;
+
+		return sql;
+	}
+
+	// 缓存中的值在Step之前一直有效，所以绑定时不需要让SQLite拷贝
+	int BindValue(SQLite3Stmt &stmt, int pos, const Value &value)
+	{
+		switch (value.type)
+		{
+		case SQLITE_INTEGER:
+			return stmt.BindInt64(pos, value.int_val);
+		case SQLITE_FLOAT:
+			return stmt.BindDouble(pos, value.double_val);
+		case SQLITE_TEXT:
+			return stmt.BindText(pos, value.text_val, SQLITE_STATIC);
+		case SQLITE_BLOB:
+			return stmt.BindBlob(pos, value.blob_val, SQLITE_STATIC);
+		default:
+			return stmt.BindNull(pos);
+		}
+	}
+
+	int StepRows(SQLite3Stmt &stmt, const Value *values, int row_num)
+	{
+		int ret = SQLITE_OK;
+		int param_num = row_num * column_num_;
+		for (int i = 0; i < param_num && ret == SQLITE_OK; ++i)
+			ret = BindValue(stmt, i + 1, values[i]);
+
+		if (ret == SQLITE_OK)
+		{
+			ret = stmt.Step();
+			if (ret == SQLITE_DONE)
+			{
+				ret = SQLITE_OK;
+				written_row_num_ += row_num;
+			}
+		}
+		stmt.ResetStmt();
+
+		return ret;
+	}
+
+	// 满一批时用多行语句写入，不满一批(Flush时)逐行写入
+	int WriteRows()
+	{
+		int ret = SQLITE_OK;
+		if (row_num_ == rows_per_stmt_)
+		{
+			ret = StepRows(batch_stmt_, values_.data(), row_num_);
+		}
+		else
+		{
+			for (int i = 0; i < row_num_ && ret == SQLITE_OK; ++i)
+				ret = StepRows(single_stmt_, &values_[(size_t)i * column_num_], 1);
+		}
+		row_num_ = 0;
+
+		return ret;
+	}
+
+	SQLite3Wrapper &db_;
+	std::string insert_head_;
+	std::string insert_tail_;
+	int column_num_;
+	int rows_per_stmt_;
+	int row_num_;
+	size_t rows_per_commit_;
+	std::chrono::milliseconds commit_interval_;
+	size_t uncommitted_row_num_;
+	uint64_t written_row_num_;
+	bool is_in_transaction_;
+	std::chrono::steady_clock::time_point transaction_start_time_;
+	std::vector<Value> values_;
+	SQLite3Stmt single_stmt_;
+	SQLite3Stmt batch_stmt_;
+};
+
+// 异步写入: 调用方把写操作投递到队列后立即返回，后台线程把连续的写操作合并到一个事务中执行，
+// 每ops_per_commit个操作、事务持续commit_interval或遇到Flush时提交一次，多个操作共用一次提交的fsync
+// 运行期间连接只能由后台线程使用；写操作的future在所在事务提交之后才就绪
+class SQLite3AsyncWriter
+{
+public:
+	typedef std::function<int(SQLite3Wrapper &)> WriteFunction;
+
+	static constexpr size_t kDefaultOpsPerCommit = 10000;
+	static constexpr size_t kMaxOpsPerPop = 1024;
+
+	explicit SQLite3AsyncWriter(SQLite3Wrapper &db)
+		: db_(db), ops_per_commit_(kDefaultOpsPerCommit), commit_interval_(std::chrono::milliseconds(100)), is_running_(false), is_in_transaction_(false)
+	{
+
+	}
+
+	SQLite3AsyncWriter(const SQLite3AsyncWriter &) = delete;
+	SQLite3AsyncWriter &operator=(const SQLite3AsyncWriter &) = delete;
+
+	~SQLite3AsyncWriter()
+	{
+		Stop();
+	}
+
+	// 需要在Start之前设置；commit_interval为0时队列一取空就提交，积压时连续的写操作仍然合并到同一事务中，直到ops_per_commit
+	void SetCommitPolicy(size_t ops_per_commit, std::chrono::milliseconds commit_interval)
+	{
+		ops_per_commit_ = ops_per_commit > 0 ? ops_per_commit : 1;
+		commit_interval_ = commit_interval;
+	}
+
+	bool Start()
+	{
+		if (is_running_ || !db_.IsOpen())
+			return false;
+
+		queue_.clear();
+		is_running_ = true;
+		thread_ = std::thread(&SQLite3AsyncWriter::Work, this);
+
+		return true;
+	}
+
+	// 执行完队列中剩余的写操作并提交后返回，Stop不能和Post/Flush并发调用
+	void Stop()
+	{
+		if (!is_running_)
+			return;
+
+		queue_.SetNoMoreFlag();
+		if (thread_.joinable())
+			thread_.join();
+		is_running_ = false;
+	}
+
+	bool IsRunning() const
+	{
+		return is_running_;
+	}
+
+	// func在后台线程中执行，返回SQLite错误码；future的值为func的错误码，func成功时为所在事务COMMIT的错误码
+	// func失败不会回滚同一事务中的其它操作，SQLite的单条语句本身是原子的
+	std::future<int> Post(WriteFunction func)
+	{
+		WriteOperation op;
+		op.func = std::move(func);
+		std::future<int> future = op.promise.get_future();
+		if (!is_running_)
+		{
+			op.promise.set_value(SQLITE_MISUSE);
+			return future;
+		}
+
+		queue_.push(std::move(op));
+		return future;
+	}
+
+	// 屏障: 之前投递的所有写操作提交之后future就绪，值为这次COMMIT的错误码
+	std::future<int> Flush()
+	{
+		WriteOperation op;
+		std::future<int> future = op.promise.get_future();
+		if (!is_running_)
+		{
+			op.promise.set_value(SQLITE_MISUSE);
+			return future;
+		}
+
+		queue_.push(std::move(op));
+		return future;
+	}
+
+private:
+	// func为空时是Flush屏障
+	struct WriteOperation
+	{
+		WriteFunction func;
+		std::promise<int> promise;
+	};
+
+	struct PendingResult
+	{
+		std::promise<int> promise;
+		int ret;
+	};
+
+	void Work()
+	{
+		std::vector<WriteOperation> ops;
+		for (;;)
+		{
+			ops.clear();
+			size_t op_num = 0;
+			if (is_in_transaction_ || !pending_.empty())
+			{
+				// 有未提交的写操作时最多等到提交时间
+				auto wait_time = commit_interval_;
+				if (is_in_transaction_)
+				{
+					auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - transaction_start_time_);
+					wait_time = elapsed < commit_interval_ ? commit_interval_ - elapsed : std::chrono::milliseconds(0);
+				}
+				op_num = queue_.pop_bulk(ops, kMaxOpsPerPop, wait_time);
+			}
+			else
+			{
+				// 没有需要提交的内容时不定时唤醒，一直等到有新的写操作或Stop
+				op_num = queue_.pop_bulk(ops, kMaxOpsPerPop);
+			}
+
+			if (op_num == 0)
+			{
+				if (is_in_transaction_ || !pending_.empty())
+					Commit();
+				if (queue_.IsNoMore() && queue_.empty())
+					break;
+
+				continue;
+			}
+
+			for (auto &op : ops)
+			{
+				if (!op.func)
+				{
+					pending_.push_back({ std::move(op.promise), SQLITE_OK });
+					Commit();
+					continue;
+				}
+
+				if (!is_in_transaction_)
+				{
+					is_in_transaction_ = db_.Begin() == SQLITE_OK;
+					transaction_start_time_ = std::chrono::steady_clock::now();
+				}
+
+				int ret = SQLITE_ERROR;
+				try
+				{
+					ret = op.func(db_);
+				}
+				catch (...)
+				{
+					LOGE("SQLite3AsyncWriter write operation threw an exception");
+				}
+				if (ret == SQLITE_DONE || ret == SQLITE_ROW)
+					ret = SQLITE_OK;
+				pending_.push_back({ std::move(op.promise), ret });
+
+				if (pending_.size() >= ops_per_commit_)
+					Commit();
+			}
+
+			// commit_interval为0时只在这次没有取满(队列已经取空)时提交，取满说明后面还有积压，继续在同一事务中执行
+			if (is_in_transaction_ && std::chrono::steady_clock::now() - transaction_start_time_ >= commit_interval_
+				&& (commit_interval_.count() > 0 || op_num < kMaxOpsPerPop))
+				Commit();
+		}
+	}
+
+	// Begin失败时写操作以自动提交方式执行，这里不再需要COMMIT；COMMIT失败时回滚，同一事务中的操作都返回失败
+	void Commit()
+	{
+		int commit_ret = SQLITE_OK;
+		if (is_in_transaction_)
+		{
+			commit_ret = db_.Commit();
+			if (commit_ret != SQLITE_OK)
+				db_.Execute("ROLLBACK", NULL, NULL, NULL);
+			is_in_transaction_ = false;
+		}
+
+		for (auto &result : pending_)
+			result.promise.set_value(result.ret != SQLITE_OK ? result.ret : commit_ret);
+		pending_.clear();
+	}
+
+	SQLite3Wrapper &db_;
+	size_t ops_per_commit_;
+	std::chrono::milliseconds commit_interval_;
+	std::atomic<bool> is_running_;
+	util::Queue<WriteOperation> queue_;
+	std::thread thread_;
+
+	// 只在后台线程中访问
+	bool is_in_transaction_;
+	std::chrono::steady_clock::time_point transaction_start_time_;
+	std::vector<PendingResult> pending_;
+};
+
+// 同一个数据库文件上的连接池: 一个读写连接和多个只读连接，数据库使用WAL模式，读连接不会被写连接阻塞
+// 连接通过Lease借出，Lease析构时自动归还；同一时刻一个连接只会借给一个线程，因此连接都以NOMUTEX方式打开
+class SQLite3Pool
+{
+public:
+	class Lease
+	{
+		friend class SQLite3Pool;
+	public:
+		Lease() : pool_(nullptr), db_(nullptr), is_writer_(false) {}
+
+		Lease(Lease &&rhs) : pool_(rhs.pool_), db_(rhs.db_), is_writer_(rhs.is_writer_)
+		{
+			rhs.db_ = nullptr;
+		}
+
+		Lease &operator=(Lease &&rhs)
+		{
+			if (&rhs != this)
+			{
+				Release();
+				pool_ = rhs.pool_;
+				db_ = rhs.db_;
+				is_writer_ = rhs.is_writer_;
+				rhs.db_ = nullptr;
+			}
+
+			return *this;
+		}
+
+		Lease(const Lease &) = delete;
+		Lease &operator=(const Lease &) = delete;
+
+		~Lease()
+		{
+			Release();
+		}
+
+		SQLite3Wrapper *operator->() const
+		{
+			return db_;
+		}
+
+		SQLite3Wrapper &operator*() const
+		{
+			return *db_;
+		}
+
+		explicit operator bool() const
+		{
+			return db_ != nullptr;
+		}
+
+		void Release()
+		{
+			if (db_)
+			{
+				pool_->Return(db_, is_writer_);
+				db_ = nullptr;
+			}
+		}
+
+	private:
+		Lease(SQLite3Pool *pool, SQLite3Wrapper *db, bool is_writer) : pool_(pool), db_(db), is_writer_(is_writer) {}
+
+		SQLite3Pool *pool_;
+		SQLite3Wrapper *db_;
+		bool is_writer_;
+	};
+
+	SQLite3Pool(const std::string &db_file_path, int reader_count)
+		: db_file_path_(db_file_path), reader_count_(reader_count < 1 ? 1 : reader_count), is_writer_free_(false), lease_count_(0)
+	{
+
+	}
+
+	~SQLite3Pool()
+	{
+		Close();
+	}
+
+	SQLite3Pool(const SQLite3Pool &) = delete;
+	SQLite3Pool &operator=(const SQLite3Pool &) = delete;
+
+	// 先打开写连接(文件不存在时创建)并切换到WAL模式，再打开只读连接
+	int Open(int busy_timeout_ms = 5000)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (writer_)
+			return SQLITE_MISUSE;
+
+		std::unique_ptr<SQLite3Wrapper> writer(new SQLite3Wrapper(db_file_path_));
+		int ret = writer->OpenDB(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX);
+		if (ret != SQLITE_OK)
+			return ret;
+		writer->SetBusyTimeout(busy_timeout_ms);
+		ret = writer->Execute("PRAGMA journal_mode=WAL", NULL, NULL, NULL);
+		if (ret != SQLITE_OK)
+			return ret;
+
+		std::vector<std::unique_ptr<SQLite3Wrapper>> readers;
+		for (int i = 0; i < reader_count_; ++i)
+		{
+			std::unique_ptr<SQLite3Wrapper> reader(new SQLite3Wrapper(db_file_path_));
+			ret = reader->OpenDB(SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX);
+			if (ret != SQLITE_OK)
+				return ret;
+			reader->SetBusyTimeout(busy_timeout_ms);
+			readers.push_back(std::move(reader));
+		}
+
+		writer_ = std::move(writer);
+		is_writer_free_ = true;
+		readers_ = std::move(readers);
+		free_readers_.clear();
+		for (auto &reader : readers_)
+			free_readers_.push_back(reader.get());
+
+		return SQLITE_OK;
+	}
+
+	// 等待所有借出的连接归还后关闭
+	void Close()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		return_cv_.wait(lock, [this] { return lease_count_ == 0; });
+		free_readers_.clear();
+		readers_.clear();
+		writer_.reset();
+		is_writer_free_ = false;
+		reader_cv_.notify_all();
+		writer_cv_.notify_all();
+	}
+
+	bool IsOpen()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return writer_ != nullptr;
+	}
+
+	// 借出一个只读连接，没有空闲连接时阻塞等待；连接池没有打开时返回空的Lease
+	Lease AcquireReader()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		reader_cv_.wait(lock, [this] { return !free_readers_.empty() || !writer_; });
+		if (!writer_)
+			return Lease();
+
+		// 后进先出，优先复用刚归还的连接，它的页缓存更可能是热的
+		SQLite3Wrapper *db = free_readers_.back();
+		free_readers_.pop_back();
+		++lease_count_;
+		return Lease(this, db, false);
+	}
+
+	Lease TryAcquireReader()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (free_readers_.empty())
+			return Lease();
+
+		SQLite3Wrapper *db = free_readers_.back();
+		free_readers_.pop_back();
+		++lease_count_;
+		return Lease(this, db, false);
+	}
+
+	// 借出唯一的写连接，被占用时阻塞等待
+	Lease AcquireWriter()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		writer_cv_.wait(lock, [this] { return is_writer_free_ || !writer_; });
+		if (!writer_)
+			return Lease();
+
+		is_writer_free_ = false;
+		++lease_count_;
+		return Lease(this, writer_.get(), true);
+	}
+
+	int ReaderCount() const
+	{
+		return reader_count_;
+	}
+
+private:
+	void Return(SQLite3Wrapper *db, bool is_writer)
+	{
+		// 在锁内通知，否则Close返回后连接池可能已经析构
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (is_writer)
+		{
+			is_writer_free_ = true;
+			writer_cv_.notify_one();
+		}
+		else
+		{
+			free_readers_.push_back(db);
+			reader_cv_.notify_one();
+		}
+		--lease_count_;
+		return_cv_.notify_all();
+	}
+
+	std::string db_file_path_;
+	int reader_count_;
+
+	std::mutex mutex_;
+	std::condition_variable reader_cv_;
+	std::condition_variable writer_cv_;
+	std::condition_variable return_cv_;
+	std::unique_ptr<SQLite3Wrapper> writer_;
+	bool is_writer_free_;
+	std::vector<std::unique_ptr<SQLite3Wrapper>> readers_;
+	std::vector<SQLite3Wrapper *> free_readers_;
+	int lease_count_;
 };
 
 #endif // !SQLITE3WRAPPER_HPP
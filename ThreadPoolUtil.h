@@ -1,18 +1,24 @@
 #ifndef __THREAD_POOL__
 #define __THREAD_POOL__
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
 #include <functional>
 #include <future>
 #include <iostream>
 #include <list>
 #include <memory>
 #include <mutex>
-#include <queue>
+#include <optional>
 #include <thread>
 #include <tuple>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -25,26 +31,342 @@ using std::endl;
 
 namespace util {
 
+/**
+ * 只能移动的任务对象，代替std::function<void()>
+ * 可调用对象不超过kInlineSize字节时直接存放在内部缓冲区中，不分配堆内存，
+ * 超过时才在堆上分配
+ */
+class TaskFunction {
+public:
+    static constexpr std::size_t kInlineSize = 64 - sizeof(void *);
+
+    TaskFunction() : ops_(nullptr) {}
+
+    template<typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, TaskFunction>::value>>
+    TaskFunction(F &&f) : ops_(nullptr) {
+        using Fn = std::decay_t<F>;
+        if constexpr (IsInline<Fn>()) {
+            new(storage_) Fn(std::forward<F>(f));
+            ops_ = &InlineOps<Fn>::kOps;
+        } else {
+            *reinterpret_cast<Fn **>(storage_) = new Fn(std::forward<F>(f));
+            ops_ = &HeapOps<Fn>::kOps;
+        }
+    }
+
+    TaskFunction(TaskFunction &&rhs) noexcept : ops_(rhs.ops_) {
+        if (ops_) {
+            ops_->move(storage_, rhs.storage_);
+            rhs.ops_ = nullptr;
+        }
+    }
+
+    TaskFunction &operator=(TaskFunction &&rhs) noexcept {
+        if (&rhs != this) {
+            Reset();
+            if (rhs.ops_) {
+                rhs.ops_->move(storage_, rhs.storage_);
+                ops_ = rhs.ops_;
+                rhs.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    TaskFunction(const TaskFunction &) = delete;
+
+    TaskFunction &operator=(const TaskFunction &) = delete;
+
+    ~TaskFunction() { Reset(); }
+
+    void operator()() { ops_->invoke(storage_); }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    void Reset() {
+        if (ops_) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    // 该类型的可调用对象能否直接存放在内部缓冲区中
+    template<typename Fn>
+    static constexpr bool IsInline() {
+        return sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(std::max_align_t) &&
+               std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void *);
+        void (*move)(void *, void *);
+        void (*destroy)(void *);
+    };
+
+    template<typename Fn>
+    struct InlineOps {
+        static void Invoke(void *p) { (*static_cast<Fn *>(p))(); }
+
+        static void Move(void *dst, void *src) {
+            new(dst) Fn(std::move(*static_cast<Fn *>(src)));
+            static_cast<Fn *>(src)->~Fn();
+        }
+
+        static void Destroy(void *p) { static_cast<Fn *>(p)->~Fn(); }
+
+        static constexpr Ops kOps{&Invoke, &Move, &Destroy};
+    };
+
+    template<typename Fn>
+    struct HeapOps {
+        static void Invoke(void *p) { (**static_cast<Fn **>(p))(); }
+
+        static void Move(void *dst, void *src) { *static_cast<Fn **>(dst) = *static_cast<Fn **>(src); }
+
+        static void Destroy(void *p) { delete *static_cast<Fn **>(p); }
+
+        static constexpr Ops kOps{&Invoke, &Move, &Destroy};
+    };
+
+    alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+    const Ops *ops_;
+};
+
+/**
+ * 环形缓冲区实现的双端队列，容量不足时按2倍扩容，出队时不释放内存，
+ * 因此队列长度稳定后入队出队都不会再分配内存(std::deque每隔几个元素就要分配/释放一次)
+ */
+template<typename T>
+class TaskDeque {
+public:
+    TaskDeque() : head_(0), size_(0) {}
+
+    bool Empty() const { return size_ == 0; }
+
+    std::size_t Size() const { return size_; }
+
+    void PushBack(T &&item) {
+        if (size_ == buffer_.size()) {
+            Grow();
+        }
+        buffer_[(head_ + size_) & (buffer_.size() - 1)] = std::move(item);
+        ++size_;
+    }
+
+    T PopFront() {
+        T item = std::move(buffer_[head_]);
+        head_ = (head_ + 1) & (buffer_.size() - 1);
+        --size_;
+        return item;
+    }
+
+    T PopBack() {
+        --size_;
+        return std::move(buffer_[(head_ + size_) & (buffer_.size() - 1)]);
+    }
+
+    void Clear() {
+        while (!Empty()) {
+            PopFront();
+        }
+    }
+
+private:
+    void Grow() {
+        std::vector<T> buffer(buffer_.empty() ? 16 : buffer_.size() * 2);
+        for (std::size_t i = 0; i < size_; ++i) {
+            buffer[i] = std::move(buffer_[(head_ + i) & (buffer_.size() - 1)]);
+        }
+        buffer_.swap(buffer);
+        head_ = 0;
+    }
+
+    std::vector<T> buffer_;
+    std::size_t head_;
+    std::size_t size_;
+};
+
+/**
+ * ThreadPool::Submit返回的轻量future，结果和异常保存在一个共享状态中，
+ * 每个任务只分配这一次内存(Run需要packaged_task的共享状态和shared_ptr<future>两次)
+ */
+template<typename T>
+class TaskFuture {
+public:
+    using ValueType = std::conditional_t<std::is_void<T>::value, char, T>;
+
+    struct State {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::atomic<bool> is_ready{false};
+        std::optional<ValueType> value;
+        std::exception_ptr error;
+
+        template<typename F>
+        void Execute(F &f) {
+            try {
+                SetValue(f, std::is_void<T>());
+            } catch (...) {
+                error = std::current_exception();
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                is_ready.store(true);
+            }
+            cv.notify_all();
+        }
+
+        template<typename F>
+        void SetValue(F &f, std::true_type) { f(); }
+
+        template<typename F>
+        void SetValue(F &f, std::false_type) { value.emplace(f()); }
+    };
+
+    TaskFuture() = default;
+
+    explicit TaskFuture(std::shared_ptr<State> state) : state_(std::move(state)) {}
+
+    bool Valid() const { return state_ != nullptr; }
+
+    bool IsReady() const { return state_ && state_->is_ready.load(); }
+
+    // 无效的TaskFuture(任务被拒绝或已经Get过)直接返回
+    void Wait() const {
+        if (!state_ || IsReady()) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        state_->cv.wait(lock, [this] { return state_->is_ready.load(); });
+    }
+
+    template<typename Rep, typename Period>
+    bool WaitFor(const std::chrono::duration<Rep, Period> &time_out) const {
+        if (!state_) {
+            return false;
+        }
+        if (IsReady()) {
+            return true;
+        }
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        return state_->cv.wait_for(lock, time_out, [this] { return state_->is_ready.load(); });
+    }
+
+    // 等待任务结束并取出结果，任务抛出的异常在这里重新抛出，只能调用一次
+    // 无效的TaskFuture调用Get抛出std::future_error(no_state)
+    T Get() {
+        if (!state_) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+        Wait();
+        std::shared_ptr<State> state = std::move(state_);
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+        if constexpr (std::is_void<T>::value) {
+            return;
+        } else {
+            return std::move(*state->value);
+        }
+    }
+
+private:
+    std::shared_ptr<State> state_;
+};
+
 class ThreadPool {
 public:
     using PoolSeconds = std::chrono::seconds;
 
+    /**
+     * 任务调度方式
+     * kGlobalQueue: 所有任务放入同一个全局队列，由一把锁保护
+     * kWorkStealing: 每个线程拥有自己的任务队列，线程内提交的任务放入本线程队列并从尾部取出(后进先出)，
+     * 外部提交的任务放入全局队列按先进先出执行，线程空闲时从其他线程队列的头部窃取任务；
+     * 此模式下线程内提交的任务不保证按提交顺序执行
+     */
+    enum class SchedulerMode {
+        kGlobalQueue = 0, kWorkStealing = 1
+    };
+
+    /**
+     * 任务队列满时的处理方式
+     * kBlock: 阻塞提交线程直到队列有空位；如果提交线程本身是线程池中的线程，则改为在该线程直接执行，避免死锁
+     * kReject: 直接拒绝，Run返回nullptr，Post返回false，Submit返回无效的TaskFuture
+     * kCallerRuns: 在提交线程中直接执行该任务
+     */
+    enum class OverflowPolicy {
+        kBlock = 0, kReject = 1, kCallerRuns = 2
+    };
+
+    /**
+     * 任务优先级，每个优先级有自己的队列(lane)，线程优先执行高优先级队列中的任务
+     * kWorkStealing模式下线程池内部线程提交的kNormal任务放入该线程的工作队列，其余任务都放入全局队列
+     */
+    enum class TaskPriority {
+        kHigh = 0, kNormal = 1, kBackground = 2
+    };
+
+    static constexpr int kPriorityNum = 3;
+
+    /**
+     * 任务在队列中等待时间的直方图，counts[0]是小于1微秒的任务个数，
+     * counts[i]是等待时间在[2^(i-1), 2^i)微秒内的任务个数，最后一个桶包含所有更长的等待
+     */
+    struct WaitTimeHistogram {
+        static constexpr int kBucketNum = 32;
+
+        uint64_t counts[kBucketNum] = {};
+        uint64_t total = 0;
+
+        // 返回p(0~1)分位等待时间所在桶的上界，单位微秒
+        uint64_t Percentile(double p) const {
+            if (total == 0) {
+                return 0;
+            }
+            uint64_t target = static_cast<uint64_t>(p * static_cast<double>(total));
+            target = std::min(std::max<uint64_t>(target, 1), total);
+            uint64_t count = 0;
+            for (int i = 0; i < kBucketNum; ++i) {
+                count += counts[i];
+                if (count >= target) {
+                    return uint64_t(1) << i;
+                }
+            }
+            return uint64_t(1) << (kBucketNum - 1);
+        }
+    };
+
     /** 线程池的配置
      * core_threads: 核心线程个数，线程池中最少拥有的线程个数，初始化就会创建好的线程，常驻于线程池
      *
      * max_threads: >=core_threads，当任务的个数太多线程池执行不过来时，
      * 内部就会创建更多的线程用于执行更多的任务，内部线程数不会超过max_threads
      *
-     * max_task_size: 内部允许存储的最大任务个数，暂时没有使用
+     * max_task_size: 内部允许存储的最大任务个数，<=0表示不限制，队列满时的处理方式见overflow_policy
      *
      * time_out: Cache线程的超时时间，Cache线程指的是max_threads-core_threads的线程,
      * 当time_out时间内没有执行任务，此线程就会被自动回收
+     *
+     * scheduler_mode: 任务调度方式，默认使用全局任务队列，见SchedulerMode
+     *
+     * overflow_policy: 任务个数达到max_task_size时新提交任务的处理方式，默认阻塞提交线程，见OverflowPolicy
+     *
+     * starvation_limit: 防止低优先级任务饿死，每个线程每取starvation_limit个任务就有一次轮流优先从
+     * kNormal/kBackground队列中取任务，<=0表示严格按优先级执行
+     *
+     * is_record_wait_time: 是否统计各优先级任务的排队等待时间，见GetWaitTimeHistogram
      */
     struct ThreadPoolConfig {
         int core_threads;
         int max_threads;
         int max_task_size;
         PoolSeconds time_out;
+        SchedulerMode scheduler_mode = SchedulerMode::kGlobalQueue;
+        OverflowPolicy overflow_policy = OverflowPolicy::kBlock;
+        int starvation_limit = 16;
+        bool is_record_wait_time = false;
     };
 
     /**
@@ -85,12 +407,41 @@ public:
     using ThreadWrapperPtr = std::shared_ptr<ThreadWrapper>;
     using ThreadPoolLock = std::unique_lock<std::mutex>;
 
+    /**
+     * kWorkStealing模式下每个线程的任务队列，存放本线程提交的任务，本线程从尾部取任务，其他线程从头部窃取
+     */
+    struct QueuedTask {
+        TaskFunction task;
+        std::chrono::steady_clock::time_point enqueue_time;
+    };
+
+    struct WorkQueue {
+        std::mutex mutex;
+        TaskDeque<QueuedTask> tasks;
+        std::atomic<int> size{0};
+        std::atomic<bool> is_owned{false};
+    };
+
+    using WorkQueuePtr = std::unique_ptr<WorkQueue>;
+
     static ThreadPool &instance() { return SingleTon<ThreadPool>::instance(); }
 
     ThreadPool() {
         this->total_function_num_.store(0);
         this->waiting_thread_num_.store(0);
 
+        this->total_thread_num_.store(0);
+        this->starting_thread_num_.store(0);
+        this->queued_task_num_.store(0);
+        this->blocked_waiter_num_.store(0);
+        this->rejected_task_num_.store(0);
+        this->blocked_task_num_.store(0);
+        this->caller_run_task_num_.store(0);
+        for (auto &lane_task_num : this->lane_task_num_) {
+            lane_task_num.store(0);
+        }
+        ResetWaitTimeHistogram();
+
         this->thread_id_.store(0);
         this->is_shutdown_.store(false);
         this->is_shutdown_now_.store(false);
@@ -107,6 +458,18 @@ public:
         this->total_function_num_.store(0);
         this->waiting_thread_num_.store(0);
 
+        this->total_thread_num_.store(0);
+        this->starting_thread_num_.store(0);
+        this->queued_task_num_.store(0);
+        this->blocked_waiter_num_.store(0);
+        this->rejected_task_num_.store(0);
+        this->blocked_task_num_.store(0);
+        this->caller_run_task_num_.store(0);
+        for (auto &lane_task_num : this->lane_task_num_) {
+            lane_task_num.store(0);
+        }
+        ResetWaitTimeHistogram();
+
         this->thread_id_.store(0);
         this->is_shutdown_.store(false);
         this->is_shutdown_now_.store(false);
@@ -125,7 +488,7 @@ public:
         if (!IsValidConfig(config)) {
             return false;
         }
-        if (config_.core_threads != config.core_threads) {
+        if (config_.core_threads != config.core_threads || config_.scheduler_mode != config.scheduler_mode) {
             return false;
         }
         config_ = config;
@@ -137,11 +500,19 @@ public:
         if (!IsAvailable()) {
             return false;
         }
+        if (IsWorkStealing()) {
+            work_queues_.clear();
+            for (int i = 0; i < config_.max_threads; ++i) {
+                work_queues_.emplace_back(std::make_unique<WorkQueue>());
+            }
+        }
         int core_thread_num = config_.core_threads;
 #ifdef MY_DEBUG
         cout << "Init thread num " << core_thread_num << endl;
 #endif
         while (core_thread_num-- > 0) {
+            ++this->total_thread_num_;
+            ++this->starting_thread_num_;
             AddThread(GetNextThreadId());
         }
 #ifdef MY_DEBUG
@@ -154,44 +525,152 @@ public:
     int GetWaitingThreadSize() { return this->waiting_thread_num_.load(); }
 
     // 获取线程池中当前线程的总个数
-    int GetTotalThreadSize() {
-        ThreadPoolLock lock(worker_thread_mutex_);
-        return this->worker_threads_.size();
-    }
+    int GetTotalThreadSize() { return this->total_thread_num_.load(); }
 
     // 放在线程池中执行函数
     template<typename F, typename... Args>
     auto Run(F &&f, Args &&... args) -> std::shared_ptr<std::future<std::result_of_t<F(Args...)>>> {
+        return Run(TaskPriority::kNormal, std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    // 以指定优先级放在线程池中执行函数
+    template<typename F, typename... Args>
+    auto Run(TaskPriority priority, F &&f, Args &&... args)
+    -> std::shared_ptr<std::future<std::result_of_t<F(Args...)>>> {
         if (this->is_shutdown_.load() || this->is_shutdown_now_.load() || !IsAvailable()) {
             return nullptr;
         }
-
-        {
-            // 防止多线程同时添加新线程, 导致新添加的线程刚进入等待状态, 还没有开始执行任务, 导致这里跳过创建新线程
-            ThreadPoolLock lock(this->thread_add_mutex_);
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
-            if (GetWaitingThreadSize() == 0 && GetTotalThreadSize() < config_.max_threads) {
-                AddThread(GetNextThreadId(), ThreadFlag::kCache);
-            }
+        TaskAdmission admission = AdmitTask();
+        if (admission == TaskAdmission::kRejected) {
+            return nullptr;
         }
 
         using return_type = std::result_of_t<F(Args...)>;
-        auto task = std::make_shared<std::packaged_task<return_type() >>(
-                std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+        std::packaged_task<return_type()> task(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
         total_function_num_++;
 
-        std::future<return_type> res = task->get_future();
-        {
-            ThreadPoolLock lock(this->task_mutex_);
-            this->tasks_.emplace([task]() { (*task)(); });
-        }
-        this->task_cv_.notify_one();
+        std::future<return_type> res = task.get_future();
+        DispatchTask(admission, priority, TaskFunction(std::move(task)));
         return std::make_shared<std::future<std::result_of_t<F(Args...)>>>(std::move(res));
     }
 
+    /**
+     * 放在线程池中执行函数，不关心返回值
+     * 可调用对象不超过TaskFunction::kInlineSize字节时整个提交过程不分配堆内存，
+     * 函数抛出的异常会被忽略
+     */
+    template<typename F>
+    bool Post(F &&f) {
+        return Post(TaskPriority::kNormal, std::forward<F>(f));
+    }
+
+    template<typename F>
+    bool Post(TaskPriority priority, F &&f) {
+        if (this->is_shutdown_.load() || this->is_shutdown_now_.load() || !IsAvailable()) {
+            return false;
+        }
+        TaskAdmission admission = AdmitTask();
+        if (admission == TaskAdmission::kRejected) {
+            return false;
+        }
+
+        total_function_num_++;
+        DispatchTask(admission, priority, TaskFunction(std::forward<F>(f)));
+        return true;
+    }
+
+    // 放在线程池中执行函数，返回TaskFuture，比Run少一次内存分配
+    template<typename F, typename... Args>
+    auto Submit(F &&f, Args &&... args) -> TaskFuture<std::result_of_t<F(Args...)>> {
+        return Submit(TaskPriority::kNormal, std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    template<typename F, typename... Args>
+    auto Submit(TaskPriority priority, F &&f, Args &&... args) -> TaskFuture<std::result_of_t<F(Args...)>> {
+        using return_type = std::result_of_t<F(Args...)>;
+        using State = typename TaskFuture<return_type>::State;
+        if (this->is_shutdown_.load() || this->is_shutdown_now_.load() || !IsAvailable()) {
+            return TaskFuture<return_type>();
+        }
+        TaskAdmission admission = AdmitTask();
+        if (admission == TaskAdmission::kRejected) {
+            return TaskFuture<return_type>();
+        }
+
+        auto state = std::make_shared<State>();
+        auto func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+        total_function_num_++;
+        DispatchTask(admission, priority, [state, func = std::move(func)]() mutable { state->Execute(func); });
+        return TaskFuture<return_type>(std::move(state));
+    }
+
+    /**
+     * 并行执行fn(i)，i属于[begin, end)，调用线程也参与执行，全部执行完才返回
+     * 区间不断二分，拆出的后一半放入共享的待执行区间中并提交一个任务，空闲线程取走最大的区间继续拆分，
+     * 直到区间不超过grain个元素；grain<=0时按线程数自动选取
+     * fn抛出的异常会在调用线程中重新抛出，此时剩余的区间不再执行
+     */
+    template<typename Index, typename F>
+    void ParallelFor(Index begin, Index end, std::common_type_t<Index> grain, F &&fn) {
+        ParallelRange(begin, end, grain, [&fn](Index first, Index last) {
+            for (Index i = first; i < last; ++i) {
+                fn(i);
+            }
+        });
+    }
+
+    /**
+     * 并行归约，range_fn(first, last)返回区间[first, last)的部分结果，reduce_fn(a, b)合并两个结果，
+     * identity为初始值；区间的拆分方式与ParallelFor相同
+     * 部分结果的合并顺序不确定，reduce_fn需要满足结合律和交换律
+     */
+    template<typename Index, typename T, typename RangeF, typename ReduceF>
+    T ParallelReduce(Index begin, Index end, std::common_type_t<Index> grain, T identity,
+                     RangeF &&range_fn, ReduceF &&reduce_fn) {
+        std::mutex result_mutex;
+        T result = std::move(identity);
+        ParallelRange(begin, end, grain, [&](Index first, Index last) {
+            T partial = range_fn(first, last);
+            std::lock_guard<std::mutex> lock(result_mutex);
+            result = reduce_fn(std::move(result), std::move(partial));
+        });
+        return result;
+    }
+
     // 获取当前线程池已经执行过的函数个数
     int GetRunnedFuncNum() { return total_function_num_.load(); }
 
+    // 获取当前排队等待执行的任务个数
+    int GetQueuedTaskSize() { return queued_task_num_.load(); }
+
+    // 获取因队列已满被拒绝的任务个数
+    int GetRejectedTaskNum() { return rejected_task_num_.load(); }
+
+    // 获取因队列已满阻塞过提交线程的任务个数
+    int GetBlockedTaskNum() { return blocked_task_num_.load(); }
+
+    // 获取因队列已满在提交线程中直接执行的任务个数
+    int GetCallerRunTaskNum() { return caller_run_task_num_.load(); }
+
+    // 获取指定优先级的任务排队等待时间直方图，需要开启is_record_wait_time
+    WaitTimeHistogram GetWaitTimeHistogram(TaskPriority priority) {
+        WaitTimeHistogram histogram;
+        int lane = static_cast<int>(priority);
+        for (int i = 0; i < WaitTimeHistogram::kBucketNum; ++i) {
+            histogram.counts[i] = wait_time_buckets_[lane][i].load(std::memory_order_relaxed);
+            histogram.total += histogram.counts[i];
+        }
+        return histogram;
+    }
+
+    void ResetWaitTimeHistogram() {
+        for (auto &buckets : wait_time_buckets_) {
+            for (auto &bucket : buckets) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
     // 关掉线程池，内部还没有执行的任务会继续执行
     void ShutDown() {
         ShutDown(false);
@@ -220,10 +699,30 @@ private:
                 this->is_shutdown_.store(true);
             }
             this->task_cv_.notify_all();
+            {
+                // 唤醒因队列已满而阻塞的提交线程
+                ThreadPoolLock lock(this->task_mutex_);
+            }
+            this->space_cv_.notify_all();
 
             while (this->GetTotalThreadSize() != 0)
                 std::this_thread::sleep_for(std::chrono::milliseconds(100));
 
+            // ShutDownNow时任务队列中可能还有未执行的任务，直接丢弃
+            {
+                ThreadPoolLock lock(this->task_mutex_);
+                for (int i = 0; i < kPriorityNum; ++i) {
+                    this->lanes_[i].Clear();
+                    this->lane_task_num_[i].store(0);
+                }
+            }
+            for (auto &queue : work_queues_) {
+                ThreadPoolLock lock(queue->mutex);
+                queue->tasks.Clear();
+                queue->size.store(0);
+            }
+            queued_task_num_.store(0);
+
             is_available_.store(false);
         }
     }
@@ -238,8 +737,31 @@ private:
         thread_ptr->id.store(id);
         thread_ptr->flag.store(thread_flag);
         auto func = [this, thread_ptr]() {
+            int queue_index = AcquireWorkQueue();
+            CurrentWorker() = {this, queue_index};
+            // 新线程在第一次取任务或进入等待前都算作空闲线程，避免提交任务时重复创建线程
+            bool is_starting = true;
+            auto mark_started = [this, &is_starting]() {
+                if (is_starting) {
+                    is_starting = false;
+                    --this->starting_thread_num_;
+                }
+            };
+            int pick_count = 0;
             for (;;) {
-                std::function<void()> task;
+                QueuedTask queued_task;
+                TaskPriority lane = TaskPriority::kNormal;
+                if (IsWorkStealing() && TryPopStealingTask(queue_index, ++pick_count, queued_task, lane)) {
+                    mark_started();
+                    if (this->is_shutdown_now_) {
+                        break;
+                    }
+                    thread_ptr->state.store(ThreadState::kRunning);
+                    NotifyTaskSpace();
+                    RecordWaitTime(lane, queued_task.enqueue_time);
+                    RunTask(queued_task.task);
+                    continue;
+                }
                 {
                     ThreadPoolLock lock(this->task_mutex_);
                     if (thread_ptr->state.load() == ThreadState::kStop) {
@@ -250,18 +772,19 @@ private:
 #endif
                     thread_ptr->state.store(ThreadState::kWaiting);
                     ++this->waiting_thread_num_;
+                    mark_started();
                     bool is_timeout = false;
                     if (thread_ptr->flag.load() == ThreadFlag::kCore) {
                         this->task_cv_.wait(lock, [this, thread_ptr] {
-                            return (this->is_shutdown_ || this->is_shutdown_now_ || !this->tasks_.empty() ||
+                            return (this->is_shutdown_ || this->is_shutdown_now_ || HasTask() ||
                                     thread_ptr->state.load() == ThreadState::kStop);
                         });
                     } else {
                         this->task_cv_.wait_for(lock, this->config_.time_out, [this, thread_ptr] {
-                            return (this->is_shutdown_ || this->is_shutdown_now_ || !this->tasks_.empty() ||
+                            return (this->is_shutdown_ || this->is_shutdown_now_ || HasTask() ||
                                     thread_ptr->state.load() == ThreadState::kStop);
                         });
-                        is_timeout = !(this->is_shutdown_ || this->is_shutdown_now_ || !this->tasks_.empty() ||
+                        is_timeout = !(this->is_shutdown_ || this->is_shutdown_now_ || HasTask() ||
                                        thread_ptr->state.load() == ThreadState::kStop);
                     }
                     --this->waiting_thread_num_;
@@ -279,7 +802,7 @@ private:
 #endif
                         break;
                     }
-                    if (this->is_shutdown_ && this->tasks_.empty()) {
+                    if (this->is_shutdown_ && !HasTask()) {
 #ifdef MY_DEBUG
                         cout << "thread id " << thread_ptr->id.load() << " shutdown" << endl;
 #endif
@@ -292,11 +815,20 @@ private:
                         break;
                     }
                     thread_ptr->state.store(ThreadState::kRunning);
-                    task = std::move(this->tasks_.front());
-                    this->tasks_.pop();
+                    if (IsWorkStealing()) {
+                        // 任务在各线程的工作队列中，回到循环开头去取
+                        continue;
+                    }
+                    PopLaneTask(++pick_count, queued_task, lane);
+                    --this->queued_task_num_;
                 }
-                task();
+                NotifyTaskSpace();
+                RecordWaitTime(lane, queued_task.enqueue_time);
+                RunTask(queued_task.task);
             }
+            mark_started();
+            ReleaseWorkQueue(queue_index);
+            CurrentWorker() = {nullptr, -1};
 
             {
                 // 将结束的线程从线程链表中删除
@@ -306,6 +838,8 @@ private:
 #ifdef MY_DEBUG
             cout << "thread id " << thread_ptr->id.load() << " running end" << endl;
 #endif
+            // ShutDown以线程总数为0作为所有线程退出的标志，之后不能再访问this
+            --this->total_thread_num_;
         };
         thread_ptr->ptr = std::make_shared<std::thread>(std::move(func));
         if (thread_ptr->ptr->joinable()) {
@@ -325,6 +859,8 @@ private:
 #endif
         if (thread_num > old_thread_num) {
             while (thread_num-- > old_thread_num) {
+                ++this->total_thread_num_;
+                ++this->starting_thread_num_;
                 AddThread(GetNextThreadId());
             }
         } else {
@@ -350,6 +886,452 @@ private:
 
     int GetNextThreadId() { return this->thread_id_++; }
 
+    enum class TaskAdmission {
+        kQueued = 0, kRejected = 1, kCallerRuns = 2
+    };
+
+    // ParallelFor/ParallelReduce中调用线程与各线程共享的状态
+    template<typename Index>
+    struct RangeState {
+        std::mutex mutex;
+        std::condition_variable cv;
+        TaskDeque<std::pair<Index, Index>> ranges;      // 拆分出来还没有执行的区间
+        Index grain;
+        std::atomic<uint64_t> remaining{0};             // 还没有执行完的元素个数
+        std::atomic<int> pending_helper_num{0};         // 已提交还没有开始执行的任务个数
+        std::atomic<bool> is_cancelled{false};
+        std::exception_ptr error;
+    };
+
+    template<typename Index, typename ChunkF>
+    void ParallelRange(Index begin, Index end, Index grain, const ChunkF &chunk_fn) {
+        if (!(begin < end)) {
+            return;
+        }
+        if (grain <= 0) {
+            Index thread_num = static_cast<Index>(std::max(1, config_.max_threads));
+            grain = std::max(static_cast<Index>(1), static_cast<Index>((end - begin) / (thread_num * 8)));
+        }
+
+        auto state = std::make_shared<RangeState<Index>>();
+        state->grain = grain;
+        state->remaining.store(static_cast<uint64_t>(end - begin));
+        state->ranges.PushBack(std::make_pair(begin, end));
+        ProcessRanges(state, &chunk_fn, false);
+
+        // 剩下的区间都已被其他线程取走，等待它们执行完
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->cv.wait(lock, [&state] { return state->remaining.load() == 0; });
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+    }
+
+    /**
+     * 不断从共享区间中取区间执行，没有区间时返回
+     * 提交的辅助任务先取最大(最早拆出)的区间，之后与调用线程一样取最近拆出的区间以保持局部性
+     * 区间全部执行完之后才执行的辅助任务取不到区间，不会再访问chunk_fn
+     */
+    template<typename Index, typename ChunkF>
+    void ProcessRanges(const std::shared_ptr<RangeState<Index>> &state, const ChunkF *chunk_fn, bool is_helper) {
+        bool is_first = true;
+        for (;;) {
+            std::pair<Index, Index> range;
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (state->ranges.Empty()) {
+                    return;
+                }
+                range = (is_helper && is_first) ? state->ranges.PopFront() : state->ranges.PopBack();
+            }
+            is_first = false;
+
+            Index first = range.first;
+            Index last = range.second;
+            while (last - first > state->grain) {
+                Index mid = first + (last - first) / 2;
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->ranges.PushBack(std::make_pair(mid, last));
+                }
+                if (state->pending_helper_num.load() < GetTotalThreadSize()) {
+                    ++state->pending_helper_num;
+                    bool is_posted = TryPost([this, state, chunk_fn]() {
+                        --state->pending_helper_num;
+                        ProcessRanges(state, chunk_fn, true);
+                    });
+                    if (!is_posted) {
+                        --state->pending_helper_num;
+                    }
+                }
+                last = mid;
+            }
+
+            if (!state->is_cancelled.load()) {
+                try {
+                    (*chunk_fn)(first, last);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (!state->error) {
+                        state->error = std::current_exception();
+                    }
+                    state->is_cancelled.store(true);
+                }
+            }
+
+            uint64_t count = static_cast<uint64_t>(last - first);
+            if (state->remaining.fetch_sub(count) == count) {
+                { std::lock_guard<std::mutex> lock(state->mutex); }
+                state->cv.notify_all();
+            }
+        }
+    }
+
+    // 内部使用的提交方式，队列已满时直接返回false，不按overflow_policy阻塞或执行
+    template<typename F>
+    bool TryPost(F &&f) {
+        if (this->is_shutdown_.load() || this->is_shutdown_now_.load() || !IsAvailable()) {
+            return false;
+        }
+        int limit = config_.max_task_size;
+        if (limit <= 0) {
+            ++this->queued_task_num_;
+        } else if (!TryReserveTaskSlot(limit)) {
+            return false;
+        }
+
+        total_function_num_++;
+        PushTask(TaskPriority::kNormal, TaskFunction(std::forward<F>(f)));
+        TryAddCacheThread();
+        return true;
+    }
+
+    bool IsWorkStealing() const { return config_.scheduler_mode == SchedulerMode::kWorkStealing; }
+
+    // 当前线程所属的线程池及其工作队列下标，用于判断任务是否由线程池内部线程提交
+    struct WorkerContext {
+        ThreadPool *pool;
+        int queue_index;
+    };
+
+    static WorkerContext &CurrentWorker() {
+        static thread_local WorkerContext context{nullptr, -1};
+        return context;
+    }
+
+    // 调用前需持有task_mutex_(kGlobalQueue模式)
+    bool HasTask() {
+        if (IsWorkStealing()) {
+            return this->queued_task_num_.load() > 0;
+        }
+        return HasLaneTask();
+    }
+
+    bool HasLaneTask() {
+        for (const auto &lane_task_num : this->lane_task_num_) {
+            if (lane_task_num.load() > 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool IsAgingTurn(int pick_count) const {
+        int limit = config_.starvation_limit;
+        return limit > 0 && pick_count % limit == 0;
+    }
+
+    /**
+     * 从全局优先级队列中取任务，调用前需持有task_mutex_
+     * 平时按kHigh、kNormal、kBackground的顺序取，轮到防饿死时交替优先取kNormal或kBackground
+     */
+    bool PopLaneTask(int pick_count, QueuedTask &queued_task, TaskPriority &lane) {
+        static const TaskPriority kPriorityOrder[] = {TaskPriority::kHigh, TaskPriority::kNormal,
+                                                      TaskPriority::kBackground};
+        static const TaskPriority kNormalAgingOrder[] = {TaskPriority::kNormal, TaskPriority::kBackground,
+                                                         TaskPriority::kHigh};
+        static const TaskPriority kBackgroundAgingOrder[] = {TaskPriority::kBackground, TaskPriority::kNormal,
+                                                             TaskPriority::kHigh};
+        const TaskPriority *order = kPriorityOrder;
+        if (IsAgingTurn(pick_count)) {
+            order = (pick_count / config_.starvation_limit) % 2 ? kBackgroundAgingOrder : kNormalAgingOrder;
+        }
+        for (int i = 0; i < kPriorityNum; ++i) {
+            int index = static_cast<int>(order[i]);
+            if (!this->lanes_[index].Empty()) {
+                queued_task = this->lanes_[index].PopFront();
+                --this->lane_task_num_[index];
+                lane = order[i];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * kWorkStealing模式下取任务：有kHigh任务或轮到防饿死时先取全局队列，然后是自己的工作队列、
+     * 全局队列中外部提交的kNormal任务、其他线程的工作队列，最后才是全局队列中的kBackground任务
+     */
+    bool TryPopStealingTask(int queue_index, int pick_count, QueuedTask &queued_task, TaskPriority &lane) {
+        int high_lane = static_cast<int>(TaskPriority::kHigh);
+        if (this->lane_task_num_[high_lane].load() > 0 || (IsAgingTurn(pick_count) && HasLaneTask())) {
+            ThreadPoolLock lock(this->task_mutex_);
+            if (PopLaneTask(pick_count, queued_task, lane)) {
+                --this->queued_task_num_;
+                return true;
+            }
+        }
+        if (TryPopOwnTask(queue_index, queued_task)) {
+            lane = TaskPriority::kNormal;
+            return true;
+        }
+        int normal_lane = static_cast<int>(TaskPriority::kNormal);
+        if (this->lane_task_num_[normal_lane].load() > 0) {
+            ThreadPoolLock lock(this->task_mutex_);
+            if (!this->lanes_[normal_lane].Empty()) {
+                queued_task = this->lanes_[normal_lane].PopFront();
+                --this->lane_task_num_[normal_lane];
+                --this->queued_task_num_;
+                lane = TaskPriority::kNormal;
+                return true;
+            }
+        }
+        if (TryStealTask(queue_index, queued_task)) {
+            lane = TaskPriority::kNormal;
+            return true;
+        }
+        if (HasLaneTask()) {
+            ThreadPoolLock lock(this->task_mutex_);
+            if (PopLaneTask(pick_count, queued_task, lane)) {
+                --this->queued_task_num_;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void RecordWaitTime(TaskPriority lane, std::chrono::steady_clock::time_point enqueue_time) {
+        if (!config_.is_record_wait_time || enqueue_time == std::chrono::steady_clock::time_point()) {
+            return;
+        }
+        auto wait_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - enqueue_time).count();
+        int bucket = 0;
+        while (wait_us > 0 && bucket < WaitTimeHistogram::kBucketNum - 1) {
+            wait_us >>= 1;
+            ++bucket;
+        }
+        wait_time_buckets_[static_cast<int>(lane)][bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Run和Submit的异常已经保存在future中，这里只会拦下Post任务抛出的异常，避免工作线程退出
+    static void RunTask(TaskFunction &task) {
+        try {
+            task();
+        } catch (...) {
+        }
+        task.Reset();
+    }
+
+    /**
+     * 提交任务前预占队列中的一个位置(queued_task_num_加1)，队列已满时按overflow_policy处理
+     */
+    TaskAdmission AdmitTask() {
+        int limit = config_.max_task_size;
+        if (limit <= 0) {
+            ++this->queued_task_num_;
+            return TaskAdmission::kQueued;
+        }
+        if (TryReserveTaskSlot(limit)) {
+            return TaskAdmission::kQueued;
+        }
+
+        OverflowPolicy policy = config_.overflow_policy;
+        if (policy == OverflowPolicy::kBlock && CurrentWorker().pool == this) {
+            // 线程池中的线程阻塞等待自己所在线程池的队列可能导致所有线程互相等待
+            policy = OverflowPolicy::kCallerRuns;
+        }
+        if (policy == OverflowPolicy::kReject) {
+            ++this->rejected_task_num_;
+            return TaskAdmission::kRejected;
+        }
+        if (policy == OverflowPolicy::kCallerRuns) {
+            ++this->caller_run_task_num_;
+            return TaskAdmission::kCallerRuns;
+        }
+
+        ++this->blocked_task_num_;
+        ThreadPoolLock lock(this->task_mutex_);
+        ++this->blocked_waiter_num_;
+        for (;;) {
+            this->space_cv_.wait(lock, [this] {
+                return this->is_shutdown_ || this->is_shutdown_now_ ||
+                       this->queued_task_num_.load() < config_.max_task_size;
+            });
+            if (this->is_shutdown_ || this->is_shutdown_now_) {
+                --this->blocked_waiter_num_;
+                ++this->rejected_task_num_;
+                return TaskAdmission::kRejected;
+            }
+            if (TryReserveTaskSlot(config_.max_task_size)) {
+                --this->blocked_waiter_num_;
+                return TaskAdmission::kQueued;
+            }
+        }
+    }
+
+    bool TryReserveTaskSlot(int limit) {
+        int queued = this->queued_task_num_.load();
+        while (queued < limit) {
+            if (this->queued_task_num_.compare_exchange_weak(queued, queued + 1)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void DispatchTask(TaskAdmission admission, TaskPriority priority, TaskFunction &&task) {
+        if (admission == TaskAdmission::kCallerRuns) {
+            RunTask(task);
+            return;
+        }
+        PushTask(priority, std::move(task));
+        TryAddCacheThread();
+    }
+
+    // 任务出队后唤醒因队列已满而阻塞的提交线程，与PushTask相同，没有阻塞线程时不加锁
+    void NotifyTaskSpace() {
+        if (this->blocked_waiter_num_.load() > 0) {
+            { ThreadPoolLock lock(this->task_mutex_); }
+            this->space_cv_.notify_one();
+        }
+    }
+
+    // 调用前需先通过AdmitTask预占队列位置
+    void PushTask(TaskPriority priority, TaskFunction &&task) {
+        QueuedTask queued_task;
+        queued_task.task = std::move(task);
+        if (config_.is_record_wait_time) {
+            queued_task.enqueue_time = std::chrono::steady_clock::now();
+        }
+
+        // 外部线程提交的任务放入全局队列按先进先出执行，如果轮流放入各线程的队列，
+        // 各线程从尾部取任务会让先提交的任务一直排在后面
+        WorkerContext &context = CurrentWorker();
+        int index = context.queue_index;
+        if (!IsWorkStealing() || work_queues_.empty() || priority != TaskPriority::kNormal ||
+            context.pool != this || index < 0) {
+            int lane = static_cast<int>(priority);
+            {
+                ThreadPoolLock lock(this->task_mutex_);
+                this->lanes_[lane].PushBack(std::move(queued_task));
+                ++this->lane_task_num_[lane];
+            }
+            this->task_cv_.notify_one();
+            return;
+        }
+
+        WorkQueue &queue = *work_queues_[index];
+        {
+            ThreadPoolLock lock(queue.mutex);
+            queue.tasks.PushBack(std::move(queued_task));
+            ++queue.size;
+        }
+
+        // 等待线程先在task_mutex_内增加waiting_thread_num_再检查queued_task_num_，
+        // 这里queued_task_num_已经在AdmitTask中增加，之后才检查waiting_thread_num_，两者至少有一方能看到对方的修改，
+        // 因此没有等待线程时不需要加锁
+        if (this->waiting_thread_num_.load() > 0) {
+            { ThreadPoolLock lock(this->task_mutex_); }
+            this->task_cv_.notify_one();
+        }
+    }
+
+    /**
+     * 排队的任务比空闲线程(等待中和刚创建还未开始取任务的线程)多时创建Cache线程，
+     * 只读写原子计数，不加锁也不休眠；通过CAS预占线程名额保证线程数不超过max_threads
+     */
+    void TryAddCacheThread() {
+        int total = this->total_thread_num_.load();
+        while (total < config_.max_threads) {
+            int idle = this->waiting_thread_num_.load() + this->starting_thread_num_.load();
+            if (this->queued_task_num_.load() <= idle) {
+                return;
+            }
+            ++this->starting_thread_num_;
+            if (this->total_thread_num_.compare_exchange_weak(total, total + 1)) {
+                AddThread(GetNextThreadId(), ThreadFlag::kCache);
+                return;
+            }
+            --this->starting_thread_num_;
+        }
+    }
+
+    // 从自己的队列尾部取任务
+    bool TryPopOwnTask(int queue_index, QueuedTask &task) {
+        if (queue_index < 0 || queue_index >= static_cast<int>(work_queues_.size())) {
+            return false;
+        }
+        WorkQueue &queue = *work_queues_[queue_index];
+        if (queue.size.load() == 0) {
+            return false;
+        }
+        ThreadPoolLock lock(queue.mutex);
+        if (queue.tasks.Empty()) {
+            return false;
+        }
+        task = queue.tasks.PopBack();
+        --queue.size;
+        --this->queued_task_num_;
+        return true;
+    }
+
+    // 从其他线程的队列头部窃取任务
+    bool TryStealTask(int queue_index, QueuedTask &task) {
+        int queue_num = static_cast<int>(work_queues_.size());
+        int start = queue_index >= 0 ? queue_index + 1 : 0;
+        for (int i = 0; i < queue_num; ++i) {
+            int index = (start + i) % queue_num;
+            if (index == queue_index) {
+                continue;
+            }
+            WorkQueue &queue = *work_queues_[index];
+            if (queue.size.load() == 0) {
+                continue;
+            }
+            ThreadPoolLock lock(queue.mutex);
+            if (!queue.tasks.Empty()) {
+                task = queue.tasks.PopFront();
+                --queue.size;
+                --this->queued_task_num_;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 为新线程分配一个没有被占用的工作队列，Reset增大max_threads后可能分配不到，此时返回-1，
+    // 该线程只窃取其他队列的任务
+    int AcquireWorkQueue() {
+        if (!IsWorkStealing()) {
+            return -1;
+        }
+        for (int i = 0; i < static_cast<int>(work_queues_.size()); ++i) {
+            bool expected = false;
+            if (work_queues_[i]->is_owned.compare_exchange_strong(expected, true)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // 线程退出后队列中剩余的任务仍会被其他线程窃取
+    void ReleaseWorkQueue(int queue_index) {
+        if (queue_index >= 0 && queue_index < static_cast<int>(work_queues_.size())) {
+            work_queues_[queue_index]->is_owned.store(false);
+        }
+    }
+
     bool IsValidConfig(ThreadPoolConfig config) {
         if (config.core_threads < 1 || config.max_threads < config.core_threads || config.time_out.count() < 1) {
             return false;
@@ -361,15 +1343,27 @@ private:
     ThreadPoolConfig config_;
 
     std::list<ThreadWrapperPtr> worker_threads_;
-    std::mutex thread_add_mutex_;
     std::mutex worker_thread_mutex_;
 
-    std::queue<std::function<void()>> tasks_;
+    TaskDeque<QueuedTask> lanes_[kPriorityNum];
+    std::atomic<int> lane_task_num_[kPriorityNum];
     std::mutex task_mutex_;
     std::condition_variable task_cv_;
+    std::condition_variable space_cv_;
+
+    std::vector<WorkQueuePtr> work_queues_;
+    std::atomic<int> queued_task_num_;
+
+    std::atomic<int> blocked_waiter_num_;
+    std::atomic<int> rejected_task_num_;
+    std::atomic<int> blocked_task_num_;
+    std::atomic<int> caller_run_task_num_;
+    std::atomic<uint64_t> wait_time_buckets_[kPriorityNum][WaitTimeHistogram::kBucketNum];
 
     std::atomic<int> total_function_num_;
     std::atomic<int> waiting_thread_num_;
+    std::atomic<int> total_thread_num_;
+    std::atomic<int> starting_thread_num_;
     std::atomic<int> thread_id_;
 
     std::atomic<bool> is_shutdown_now_;
@@ -377,6 +1371,176 @@ private:
     std::atomic<bool> is_available_;
 };
 
+/**
+ * 基于ThreadPool的任务依赖图(DAG)
+ * 通过AddNode添加节点，Precede(a, b)表示a执行完之后b才能执行；Run之后依赖为0的节点提交到线程池，
+ * 节点执行完时把后继节点的剩余依赖数减1，减到0的后继直接在当前线程接着执行一个、其余提交到线程池，
+ * 整个过程不会有线程阻塞在future::get()上等待前驱节点
+ *
+ * 用法:
+ *     util::TaskGraph graph(util::ThreadPool::instance());
+ *     auto a = graph.AddNode([] { ... });
+ *     auto b = graph.AddNode([] { ... });
+ *     graph.Precede(a, b);
+ *     graph.Run();
+ *     graph.Wait();
+ *
+ * 节点抛出异常后，之后还没有开始执行的节点都会被跳过，异常在Wait中重新抛出
+ * Run之后到Wait返回之前不能再添加节点或依赖
+ */
+class TaskGraph {
+public:
+    using NodeId = std::size_t;
+
+    explicit TaskGraph(ThreadPool &pool) : pool_(pool), remaining_node_num_(0), is_cancelled_(false) {}
+
+    TaskGraph(const TaskGraph &) = delete;
+
+    TaskGraph &operator=(const TaskGraph &) = delete;
+
+    ~TaskGraph() { WaitFinish(); }
+
+    template<typename F>
+    NodeId AddNode(F &&f) {
+        // 节点放在std::deque中，添加新节点时已有节点的地址不变
+        nodes_.emplace_back();
+        nodes_.back().task = TaskFunction(std::forward<F>(f));
+        nodes_.back().index = nodes_.size() - 1;
+        return nodes_.back().index;
+    }
+
+    // from执行完之后才能执行to
+    void Precede(NodeId from, NodeId to) {
+        nodes_[from].successors.push_back(&nodes_[to]);
+        ++nodes_[to].dependency_num;
+    }
+
+    std::size_t GetNodeSize() const { return nodes_.size(); }
+
+    /**
+     * 开始执行整个图，图中有环或者线程池不可用时返回false，此时不会执行任何节点
+     */
+    bool Run() {
+        if (!pool_.IsAvailable() || HasCycle()) {
+            return false;
+        }
+
+        error_ = nullptr;
+        is_cancelled_.store(false);
+        remaining_node_num_.store(nodes_.size());
+        std::vector<Node *> ready_nodes;
+        for (Node &node : nodes_) {
+            node.pending.store(node.dependency_num);
+            if (node.dependency_num == 0) {
+                ready_nodes.push_back(&node);
+            }
+        }
+        for (Node *node : ready_nodes) {
+            Schedule(node);
+        }
+        return true;
+    }
+
+    // 等待所有节点执行完，节点抛出的第一个异常在这里重新抛出
+    void Wait() {
+        WaitFinish();
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+private:
+    struct Node {
+        TaskFunction task;
+        std::vector<Node *> successors;
+        std::size_t index = 0;
+        int dependency_num = 0;
+        std::atomic<int> pending{0};
+    };
+
+    void WaitFinish() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return remaining_node_num_.load() == 0; });
+    }
+
+    void Schedule(Node *node) {
+        if (!pool_.Post([this, node] { Execute(node); })) {
+            // 线程池已经关闭，直接在当前线程执行，保证Wait能够返回
+            Execute(node);
+        }
+    }
+
+    // 执行节点，减少后继节点的依赖数；就绪的后继留一个在当前线程继续执行，其余提交到线程池
+    void Execute(Node *node) {
+        while (node) {
+            if (!is_cancelled_.load()) {
+                try {
+                    node->task();
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (!error_) {
+                        error_ = std::current_exception();
+                    }
+                    is_cancelled_.store(true);
+                }
+            }
+
+            Node *next = nullptr;
+            for (Node *successor : node->successors) {
+                if (--successor->pending == 0) {
+                    if (next) {
+                        Schedule(next);
+                    }
+                    next = successor;
+                }
+            }
+
+            {
+                // 计数必须在锁内减少: WaitFinish在锁内看到0后TaskGraph随时可能析构，
+                // 在锁外减少时本线程之后再加锁通知就会访问已经释放的mutex_和cv_
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (--remaining_node_num_ == 0) {
+                    cv_.notify_all();
+                }
+            }
+            node = next;
+        }
+    }
+
+    // Kahn算法检查图中是否有环
+    bool HasCycle() const {
+        std::vector<int> in_degree(nodes_.size());
+        std::vector<const Node *> ready_nodes;
+        for (const Node &node : nodes_) {
+            in_degree[node.index] = node.dependency_num;
+            if (node.dependency_num == 0) {
+                ready_nodes.push_back(&node);
+            }
+        }
+
+        std::size_t visited_num = 0;
+        while (!ready_nodes.empty()) {
+            const Node *node = ready_nodes.back();
+            ready_nodes.pop_back();
+            ++visited_num;
+            for (const Node *successor : node->successors) {
+                if (--in_degree[successor->index] == 0) {
+                    ready_nodes.push_back(successor);
+                }
+            }
+        }
+        return visited_num != nodes_.size();
+    }
+
+    ThreadPool &pool_;
+    std::deque<Node> nodes_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::atomic<std::size_t> remaining_node_num_;
+    std::atomic<bool> is_cancelled_;
+    std::exception_ptr error_;
+};
 
 }  // namespace util
 
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// 基准程序的数据量按--scale=x缩放，默认1，例如--scale=0.1只跑十分之一的数据
+inline double BenchScale(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--scale=", 8) == 0) {
+            double scale = std::atof(argv[i] + 8);
+            return scale > 0 ? scale : 1;
+        }
+    }
+    return 1;
+}
+
+inline long long Scaled(long long n, double scale) {
+    long long scaled = static_cast<long long>(n * scale);
+    return scaled > 0 ? scaled : 1;
+}
+
+inline double ElapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 返回fn执行的毫秒数
+template<typename F>
+double MeasureMs(F &&fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return ElapsedMs(start);
+}
+
+#define RUN_BENCH(func, scale) \
+do { \
+    printf("== %s\n", #func); \
+    func(scale); \
+    fflush(stdout); \
+} while (0)
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// 条件不成立时打印位置并以非0退出，测试程序由ctest按退出码判断结果
+#define CHECK(cond) \
+do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+        std::exit(1); \
+    } \
+} while (0)
+
+#define RUN_TEST(func) \
+do { \
+    fprintf(stderr, "[ RUN  ] %s\n", #func); \
+    func(); \
+    fprintf(stderr, "[  OK  ] %s\n", #func); \
+} while (0)
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+// 与file_util_test.cpp相同，只在这里关掉FileFilterUtil.h原有的-Wall警告
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-compare"
+#pragma GCC diagnostic ignored "-Wparentheses"
+#include "util/FileFilterUtil.h"
+#pragma GCC diagnostic pop
+#include "util/FileUtil.h"
+#include "util/ParallelScanner.h"
+#include "util/ThreadPoolUtil.h"
+#include "BenchUtil.h"
+
+using util::ThreadPool;
+using util::file::ParallelScanner;
+
+namespace {
+
+const std::string kRoot = "file_util_bench_tree";
+
+// kRoot/d{0..19}/s{i}/f{0..49}.jpg，共dir_num个叶子目录，返回文件数
+long long MakeTree(long long dir_num) {
+    fs::remove_all(kRoot);
+    const int kFilePerDir = 50;
+    for (long long i = 0; i < dir_num; ++i) {
+        std::string dir = kRoot + "/d" + std::to_string(i % 20) + "/s" + std::to_string(i);
+        fs::create_directories(dir);
+        for (int f = 0; f < kFilePerDir; ++f) {
+            std::ofstream(dir + "/f" + std::to_string(f) + ".jpg");
+        }
+    }
+    return dir_num * kFilePerDir;
+}
+
+// 单线程递归遍历，返回普通文件数
+long long WalkRecursiveIterator() {
+    long long file_num = 0;
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(fs::u8path(kRoot), ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_regular_file(ec)) {
+            ++file_num;
+        }
+    }
+    return file_num;
+}
+
+#ifdef __linux__
+long long WalkDirReader(const std::string &dir) {
+    long long file_num = 0;
+    util::file::DirReader reader(dir);
+    util::file::DirEntry entry;
+    while (reader.Next(entry)) {
+        if (entry.IsDir()) {
+            file_num += WalkDirReader(dir + "/" + entry.name);
+        } else if (entry.IsFile()) {
+            ++file_num;
+        }
+    }
+    return file_num;
+}
+#endif
+
+// user-024: 合成目录树上单线程fs::recursive_directory_iterator、单线程DirReader与1/4/16/64线程ParallelScanner的对比
+// 先完整遍历一次预热目录项缓存，每种方式取3次中最快的一次
+void BenchScan(double scale) {
+    const long long kFileNum = MakeTree(Scaled(400, scale));
+    WalkRecursiveIterator();
+
+    auto best_ms = [](auto &&fn, long long &file_num) {
+        double best = 1e300;
+        for (int round = 0; round < 3; ++round) {
+            double ms = MeasureMs([&] { file_num = fn(); });
+            best = std::min(best, ms);
+        }
+        return best;
+    };
+    auto report = [kFileNum](const char *name, double ms, long long file_num, double base_ms) {
+        printf("%-28s files=%-7lld %8.1f ms %8.0f files/ms (%.2fx)%s\n", name, file_num, ms, file_num / ms, base_ms / ms,
+               file_num == kFileNum ? "" : ", file count mismatch");
+    };
+
+    long long file_num = 0;
+    double base_ms = best_ms(WalkRecursiveIterator, file_num);
+    report("serial recursive_iterator", base_ms, file_num, base_ms);
+#ifdef __linux__
+    double reader_ms = best_ms([] { return WalkDirReader(kRoot); }, file_num);
+    report("serial DirReader", reader_ms, file_num, base_ms);
+#endif
+
+    for (int thread_num : {1, 4, 16, 64}) {
+        ThreadPool::ThreadPoolConfig config{thread_num, thread_num, 1024, std::chrono::seconds(5)};
+        ThreadPool pool(config);
+        pool.Start();
+        double ms = best_ms([&pool] {
+            ParallelScanner<> scanner(pool, nullptr);
+            scanner.Start(kRoot);
+            long long num = 0;
+            while (scanner.Next()) {
+                ++num;
+            }
+            return num;
+        }, file_num);
+        char name[32];
+        snprintf(name, sizeof(name), "ParallelScanner threads=%d", thread_num);
+        report(name, ms, file_num, base_ms);
+    }
+    fs::remove_all(kRoot);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    double scale = BenchScale(argc, argv);
+    RUN_BENCH(BenchScan, scale);
+    return 0;
+}
@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// FileFilterUtil.h原有的有符号/无符号比较和&&、||混用会产生-Wall警告，只在这里关掉
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-compare"
+#pragma GCC diagnostic ignored "-Wparentheses"
+#include "util/FileFilterUtil.h"
+#pragma GCC diagnostic pop
+#include "util/ParallelScanner.h"
+#include "util/ThreadPoolUtil.h"
+#include "TestUtil.h"
+
+using util::ThreadPool;
+using util::file::Filter;
+using util::file::ParallelScanner;
+
+namespace {
+
+const std::string kRoot = "file_util_test_tree";
+
+void WriteFile(const std::string &path, std::size_t size) {
+    std::ofstream out(path, std::ios::binary);
+    out << std::string(size, 'x');
+}
+
+/**
+ * kRoot/d{0..9}/s{0..9}/f{0..9}.jpg 共1000个文件，每个目录另有一个.txt
+ * kRoot/skip/下的文件应被IsFilterDir剪掉，kRoot/.hidden.jpg为隐藏文件，kRoot/big.jpg为100字节
+ */
+void MakeTree() {
+    fs::remove_all(kRoot);
+    for (int d = 0; d < 10; ++d) {
+        for (int s = 0; s < 10; ++s) {
+            std::string dir = kRoot + "/d" + std::to_string(d) + "/s" + std::to_string(s);
+            fs::create_directories(dir);
+            for (int f = 0; f < 10; ++f) {
+                WriteFile(dir + "/f" + std::to_string(f) + ".jpg", 1);
+            }
+            WriteFile(dir + "/note.txt", 1);
+        }
+    }
+    fs::create_directories(kRoot + "/skip/inner");
+    WriteFile(kRoot + "/skip/inner/a.jpg", 1);
+    WriteFile(kRoot + "/.hidden.jpg", 1);
+    WriteFile(kRoot + "/big.jpg", 100);
+}
+
+Filter MakeFilter(bool is_filter_hidden, unsigned int file_size_max = 0) {
+    static const char *kExcludePaths[] = {"/skip"};
+    static const char *kIncludeExts[] = {".JPG"};
+    Filter::Config config{file_size_max, 0, kExcludePaths, 1, kIncludeExts, 1, is_filter_hidden};
+    return Filter(config);
+}
+
+ThreadPool::ThreadPoolConfig MakeConfig(int threads, ThreadPool::SchedulerMode mode = ThreadPool::SchedulerMode::kGlobalQueue) {
+    ThreadPool::ThreadPoolConfig config{threads, threads, 1024, std::chrono::seconds(5)};
+    config.scheduler_mode = mode;
+    return config;
+}
+
+std::vector<std::string> ScanAll(ThreadPool &pool, Filter *filter, std::size_t queue_capacity = 4096) {
+    ParallelScanner<> scanner(pool, filter, queue_capacity);
+    CHECK(scanner.Start(kRoot));
+    std::vector<std::string> paths;
+    while (auto path = scanner.Next()) {
+        paths.push_back(*path);
+    }
+    CHECK(scanner.GetFileNum() == paths.size());
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+void TestScannerFilter() {
+    ThreadPool pool(MakeConfig(4));
+    CHECK(pool.Start());
+
+    Filter filter = MakeFilter(true);
+    std::vector<std::string> paths = ScanAll(pool, &filter, 8);
+    CHECK(paths.size() == 1001);
+    for (const std::string &path : paths) {
+        CHECK(path.find("/skip") == std::string::npos);
+        CHECK(path.find(".hidden") == std::string::npos);
+        CHECK(util::file::GetExtension(path) == ".jpg");
+    }
+
+    Filter keep_hidden = MakeFilter(false);
+    CHECK(ScanAll(pool, &keep_hidden).size() == 1002);
+
+    Filter small_only = MakeFilter(true, 10);
+    paths = ScanAll(pool, &small_only);
+    CHECK(paths.size() == 1000);
+    CHECK(std::find(paths.begin(), paths.end(), kRoot + "/big.jpg") == paths.end());
+
+    // 不过滤时包括.txt、skip目录和隐藏文件
+    CHECK(ScanAll(pool, nullptr).size() == 1000 + 100 + 1 + 1 + 1);
+}
+
+// user-025: 按路径过滤的IsFilterFile，隐藏文件只在开启过滤时判断，其余条件不受影响
+void TestFilterFileByPath() {
+    Filter filter = MakeFilter(true);
+    CHECK(filter.IsFilterFile(kRoot + "/.hidden.jpg"));
+    CHECK(!filter.IsFilterFile(kRoot + "/d0/s0/f0.jpg"));
+    CHECK(filter.IsFilterFile(kRoot + "/d0/s0/note.txt"));
+    CHECK(filter.IsFilterFile(kRoot + "/skip/inner/a.jpg"));
+
+    Filter keep_hidden = MakeFilter(false);
+    CHECK(!keep_hidden.IsFilterFile(kRoot + "/.hidden.jpg"));
+    CHECK(keep_hidden.IsFilterFile(kRoot + "/d0/s0/note.txt"));
+
+    Filter small_only = MakeFilter(false, 10);
+    CHECK(small_only.IsFilterFile(kRoot + "/big.jpg"));
+    CHECK(!small_only.IsFilterFile(kRoot + "/.hidden.jpg"));
+}
+
+// 在单独的线程中取空扫描结果，超时说明Next一直没有返回空值
+// 线程分离，超时后CHECK直接退出进程，不会阻塞在等待该线程上
+bool DrainWithin(ParallelScanner<> &scanner, std::chrono::seconds timeout) {
+    auto drained = std::make_shared<std::promise<void>>();
+    std::future<void> future = drained->get_future();
+    std::thread([&scanner, drained] {
+        while (scanner.Next()) {
+        }
+        drained->set_value();
+    }).detach();
+    return future.wait_for(timeout) == std::future_status::ready;
+}
+
+// user-024: 线程池ShutDownNow丢弃排队中的扫描任务后，Next仍能结束，Stop和析构不会一直等待
+void TestScannerPoolShutDownNow() {
+    for (auto mode : {ThreadPool::SchedulerMode::kGlobalQueue, ThreadPool::SchedulerMode::kWorkStealing}) {
+        ThreadPool pool(MakeConfig(1, mode));
+        CHECK(pool.Start());
+
+        // 唯一的线程被占住，扫描任务只能排队
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        std::atomic<bool> is_running{false};
+        CHECK(pool.Post([released, &is_running] {
+            is_running = true;
+            released.wait();
+        }));
+        while (!is_running.load()) {
+            std::this_thread::yield();
+        }
+
+        Filter filter = MakeFilter(true);
+        ParallelScanner<> scanner(pool, &filter);
+        CHECK(scanner.Start(kRoot));
+
+        std::thread shutdown_thread([&pool] { pool.ShutDownNow(); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        release.set_value();
+        shutdown_thread.join();
+
+        CHECK(DrainWithin(scanner, std::chrono::seconds(10)));
+        CHECK(scanner.IsDone());
+        scanner.Stop();
+    }
+}
+
+// user-024: 线程池已经关闭时Start返回false，Next立即结束
+void TestScannerPoolUnavailable() {
+    ThreadPool pool(MakeConfig(1));
+    CHECK(pool.Start());
+    pool.ShutDown();
+
+    ParallelScanner<> scanner(pool, nullptr);
+    CHECK(!scanner.Start(kRoot));
+    CHECK(DrainWithin(scanner, std::chrono::seconds(10)));
+    CHECK(scanner.IsDone());
+}
+
+// 取到一部分结果后Stop，阻塞在满队列上的扫描线程要能退出
+void TestScannerStopEarly() {
+    ThreadPool pool(MakeConfig(4));
+    CHECK(pool.Start());
+    for (int round = 0; round < 20; ++round) {
+        ParallelScanner<> scanner(pool, nullptr, 4);
+        CHECK(scanner.Start(kRoot));
+        for (int i = 0; i < 10; ++i) {
+            CHECK(scanner.Next());
+        }
+        scanner.Stop();
+        CHECK(scanner.IsDone());
+    }
+}
+
+}  // namespace
+
+int main() {
+    MakeTree();
+    RUN_TEST(TestScannerFilter);
+    RUN_TEST(TestFilterFileByPath);
+    RUN_TEST(TestScannerPoolShutDownNow);
+    RUN_TEST(TestScannerPoolUnavailable);
+    RUN_TEST(TestScannerStopEarly);
+    fs::remove_all(kRoot);
+    return 0;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdio>
+
+// 测试用的LOGE，工程中由上层的LogUtil.hpp提供
+#define LOGE(format, ...) fprintf(stderr, format, ##__VA_ARGS__)
@@ -0,0 +1,4 @@
+#pragma once
+
+// 测试用，工程中由上层的util/FileUtil.hpp提供
+#include "util/FileUtil.h"
@@ -0,0 +1,71 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "util/Queue.h"
+#include "BenchUtil.h"
+
+namespace {
+
+// thread_num个生产者和thread_num个消费者通过queue传递item_num个元素，返回毫秒数
+template<typename QueueT>
+double RunProducersConsumers(QueueT &queue, int thread_num, long long item_num) {
+    long long per_producer = item_num / thread_num;
+    std::atomic<long long> sum{0};
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> consumers;
+    for (int c = 0; c < thread_num; ++c) {
+        consumers.emplace_back([&queue, &sum] {
+            long long local_sum = 0;
+            while (auto item = queue.pop()) {
+                local_sum += *item;
+            }
+            sum += local_sum;
+        });
+    }
+    std::vector<std::thread> producers;
+    for (int p = 0; p < thread_num; ++p) {
+        producers.emplace_back([&queue, per_producer] {
+            for (long long i = 0; i < per_producer; ++i) {
+                queue.push(static_cast<int64_t>(i));
+            }
+        });
+    }
+    for (auto &producer : producers) {
+        producer.join();
+    }
+    queue.SetNoMoreFlag();
+    for (auto &consumer : consumers) {
+        consumer.join();
+    }
+    double ms = ElapsedMs(start);
+    if (sum.load() != thread_num * (per_producer * (per_producer - 1) / 2)) {
+        printf("checksum mismatch\n");
+    }
+    return ms;
+}
+
+// user-008: 1:1、4:4、16:16个生产者/消费者时Queue与MPMCQueue的吞吐
+void BenchProducerConsumer(double scale) {
+    const long long kItemNum = Scaled(4000000, scale);
+    for (int thread_num : {1, 4, 16}) {
+        long long item_num = kItemNum / thread_num * thread_num;
+        util::Queue<int64_t> queue;
+        double queue_ms = RunProducersConsumers(queue, thread_num, item_num);
+        util::MPMCQueue<int64_t> mpmc_queue(1024);
+        double mpmc_ms = RunProducersConsumers(mpmc_queue, thread_num, item_num);
+        printf("%2d:%-2d items=%lld Queue %.2f M/s, MPMCQueue(1024) %.2f M/s\n", thread_num, thread_num, item_num,
+               item_num / queue_ms / 1000, item_num / mpmc_ms / 1000);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    double scale = BenchScale(argc, argv);
+    RUN_BENCH(BenchProducerConsumer, scale);
+    return 0;
+}
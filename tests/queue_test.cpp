@@ -0,0 +1,317 @@
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "util/Queue.h"
+#include "TestUtil.h"
+
+using util::MPMCQueue;
+
+namespace {
+
+// 统计存活对象个数的只能移动的类型
+struct Tracked {
+    static std::atomic<int> alive_num;
+
+    explicit Tracked(int v) : value(new int(v)) { ++alive_num; }
+
+    Tracked(Tracked &&rhs) noexcept : value(std::move(rhs.value)) { ++alive_num; }
+
+    Tracked &operator=(Tracked &&rhs) noexcept = default;
+
+    Tracked(const Tracked &) = delete;
+
+    Tracked &operator=(const Tracked &) = delete;
+
+    ~Tracked() { --alive_num; }
+
+    std::unique_ptr<int> value;
+};
+
+std::atomic<int> Tracked::alive_num{0};
+
+// user-008: 容量取整、满和空的边界、单线程下的先进先出，以及析构时销毁剩余元素
+void TestMPMCBoundaries() {
+    CHECK(MPMCQueue<int>(1).capacity() == 2);
+    CHECK(MPMCQueue<int>(5).capacity() == 8);
+    CHECK(MPMCQueue<int>(8).capacity() == 8);
+    {
+        MPMCQueue<Tracked> queue(4);
+        CHECK(queue.empty());
+        CHECK(!queue.try_pop());
+        for (int round = 0; round < 3; ++round) {
+            for (int i = 0; i < 4; ++i) {
+                CHECK(queue.try_emplace(round * 10 + i));
+            }
+            CHECK(queue.full());
+            CHECK(!queue.try_push(Tracked(-1)));
+            for (int i = 0; i < 4; ++i) {
+                std::optional<Tracked> item = queue.try_pop();
+                CHECK(item && *item->value == round * 10 + i);
+            }
+            CHECK(queue.empty());
+            CHECK(!queue.full());
+            CHECK(!queue.try_pop());
+        }
+        CHECK(Tracked::alive_num.load() == 0);
+        queue.push(Tracked(1));
+        queue.emplace(2);
+        CHECK(Tracked::alive_num.load() == 2);
+    }
+    CHECK(Tracked::alive_num.load() == 0);
+
+    // SetNoMoreFlag之后剩余的元素仍然能取出，取空后pop返回空值
+    MPMCQueue<int> queue(4);
+    queue.push(1);
+    queue.SetNoMoreFlag();
+    CHECK(queue.IsNoMore());
+    CHECK(queue.pop() == 1);
+    CHECK(!queue.pop());
+    queue.clear();
+    CHECK(!queue.IsNoMore());
+}
+
+// user-008: 多生产者多消费者，容量很小使push/pop反复经过满和空的边界，每个元素恰好被取出一次，
+// 每个消费者看到的同一生产者的元素保持生产顺序
+void TestMPMCProducersConsumers() {
+    const int kItemNum = 20000;
+    for (int thread_num : {1, 4, 16}) {
+        MPMCQueue<std::unique_ptr<int>> queue(8);
+        std::vector<std::atomic<int>> seen(thread_num * kItemNum);
+        std::atomic<int> order_error_num{0};
+        std::vector<std::thread> producers;
+        std::vector<std::thread> consumers;
+        for (int c = 0; c < thread_num; ++c) {
+            consumers.emplace_back([&] {
+                std::vector<int> last(thread_num, -1);
+                while (std::optional<std::unique_ptr<int>> item = queue.pop()) {
+                    int value = **item;
+                    ++seen[value];
+                    int producer = value / kItemNum;
+                    if (value % kItemNum <= last[producer]) {
+                        ++order_error_num;
+                    }
+                    last[producer] = value % kItemNum;
+                }
+            });
+        }
+        for (int p = 0; p < thread_num; ++p) {
+            producers.emplace_back([&queue, p] {
+                for (int i = 0; i < kItemNum; ++i) {
+                    queue.push(std::make_unique<int>(p * kItemNum + i));
+                }
+            });
+        }
+        for (auto &producer : producers) {
+            producer.join();
+        }
+        queue.SetNoMoreFlag();
+        for (auto &consumer : consumers) {
+            consumer.join();
+        }
+
+        for (auto &count : seen) {
+            CHECK(count.load() == 1);
+        }
+        CHECK(order_error_num.load() == 0);
+        CHECK(queue.empty());
+    }
+}
+
+// user-008: 消费者在空队列上休眠时，SetNoMoreFlag唤醒所有消费者
+void TestMPMCNoMoreWakesConsumers() {
+    MPMCQueue<int> queue(4);
+    std::atomic<int> finished_num{0};
+    std::vector<std::thread> consumers;
+    for (int i = 0; i < 4; ++i) {
+        consumers.emplace_back([&] {
+            CHECK(!queue.pop());
+            ++finished_num;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(finished_num.load() == 0);
+    queue.SetNoMoreFlag();
+    for (auto &consumer : consumers) {
+        consumer.join();
+    }
+    CHECK(finished_num.load() == 4);
+}
+
+// user-009: push_bulk一次放入的元素保持顺序，左值拷贝、右值移动；pop_bulk按顺序取出最多max_n个
+void TestQueueBulkOrder() {
+    util::Queue<int> queue;
+    std::vector<int> values{1, 2, 3, 4, 5};
+    queue.push_bulk(values);
+    CHECK(values.size() == 5);
+    queue.push(6);
+    queue.push_bulk(std::vector<int>{7, 8});
+
+    std::vector<int> out{0};
+    CHECK(queue.pop_bulk(out, 3) == 3);
+    CHECK(queue.pop_bulk(out, 100, std::chrono::milliseconds(0)) == 5);
+    CHECK((out == std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8}));
+    CHECK(queue.empty());
+
+    util::Queue<std::unique_ptr<int>> move_queue;
+    std::vector<std::unique_ptr<int>> items;
+    for (int i = 0; i < 3; ++i) {
+        items.push_back(std::make_unique<int>(i));
+    }
+    move_queue.push_bulk(std::move(items));
+    std::vector<std::unique_ptr<int>> moved;
+    CHECK(move_queue.pop_bulk(moved, 10) == 3);
+    for (int i = 0; i < 3; ++i) {
+        CHECK(*moved[i] == i);
+    }
+}
+
+// user-009: 只能移动的元素通过push(T&&)、emplace放入，pop按顺序取出
+void TestQueueMoveOnly() {
+    util::Queue<std::unique_ptr<int>> queue;
+    queue.push(std::make_unique<int>(1));
+    queue.emplace(new int(2));
+    auto item = std::make_unique<int>(3);
+    queue.push(std::move(item));
+    CHECK(!item);
+    for (int i = 1; i <= 3; ++i) {
+        std::shared_ptr<std::unique_ptr<int>> popped = queue.pop();
+        CHECK(popped && **popped == i);
+    }
+
+    util::Queue<Tracked> tracked_queue;
+    tracked_queue.emplace(7);
+    tracked_queue.push(Tracked(8));
+    CHECK(*tracked_queue.pop()->value == 7);
+    CHECK(*tracked_queue.pop()->value == 8);
+    CHECK(Tracked::alive_num.load() == 0);
+}
+
+// user-009: pop_bulk等待期间有元素放入就立即返回已有的部分，不等满max_n也不等到超时；空队列等到超时返回0
+void TestQueuePopBulkTimeout() {
+    util::Queue<int> queue;
+    std::vector<int> out;
+    auto start = std::chrono::steady_clock::now();
+    CHECK(queue.pop_bulk(out, 10, std::chrono::milliseconds(50)) == 0);
+    CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(45));
+
+    std::thread producer([&queue] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        queue.push_bulk(std::vector<int>{1, 2, 3});
+    });
+    start = std::chrono::steady_clock::now();
+    CHECK(queue.pop_bulk(out, 10, std::chrono::seconds(10)) == 3);
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+    CHECK((out == std::vector<int>{1, 2, 3}));
+    producer.join();
+}
+
+// user-009: SetNoMoreFlag唤醒阻塞在pop、pop_bulk和带超时的pop_bulk上的消费者
+void TestQueueNoMoreWakesConsumers() {
+    util::Queue<int> queue;
+    std::atomic<int> finished_num{0};
+    std::vector<std::thread> consumers;
+    for (int i = 0; i < 2; ++i) {
+        consumers.emplace_back([&] {
+            CHECK(!queue.pop());
+            ++finished_num;
+        });
+        consumers.emplace_back([&] {
+            std::vector<int> out;
+            CHECK(queue.pop_bulk(out, 10) == 0);
+            ++finished_num;
+        });
+        consumers.emplace_back([&] {
+            std::vector<int> out;
+            auto start = std::chrono::steady_clock::now();
+            CHECK(queue.pop_bulk(out, 10, std::chrono::seconds(30)) == 0);
+            CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(10));
+            ++finished_num;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(finished_num.load() == 0);
+    queue.SetNoMoreFlag();
+    for (auto &consumer : consumers) {
+        consumer.join();
+    }
+    CHECK(finished_num.load() == 6);
+    CHECK(queue.IsNoMore());
+
+    // SetNoMoreFlag之后剩余的元素仍然能取出
+    queue.clear();
+    queue.push_bulk(std::vector<int>{1, 2});
+    queue.SetNoMoreFlag();
+    std::vector<int> out;
+    CHECK(queue.pop_bulk(out, 1) == 1);
+    CHECK(*queue.pop() == 2);
+    CHECK(!queue.pop());
+}
+
+// user-010: 容量为8的SPSCQueue传递的元素数是容量的上万倍，环形缓冲区反复回绕，消费者看到的顺序与生产顺序一致
+void TestSPSCOrderWrapAround() {
+    const int kItemNum = 100000;
+    util::SPSCQueue<std::unique_ptr<int>> queue(5);
+    CHECK(queue.capacity() == 8);
+    std::thread producer([&queue] {
+        for (int i = 0; i < kItemNum; ++i) {
+            if (i % 3 == 0) {
+                queue.emplace(new int(i));
+            } else {
+                queue.push(std::make_unique<int>(i));
+            }
+        }
+        queue.SetNoMoreFlag();
+    });
+    int expected = 0;
+    while (std::optional<std::unique_ptr<int>> item = queue.pop()) {
+        CHECK(**item == expected);
+        ++expected;
+    }
+    producer.join();
+    CHECK(expected == kItemNum);
+    CHECK(queue.empty());
+}
+
+// user-010: 满和空的边界，以及析构时销毁剩余元素
+void TestSPSCBoundaries() {
+    {
+        util::SPSCQueue<Tracked> queue(4);
+        CHECK(!queue.try_pop());
+        for (int round = 0; round < 5; ++round) {
+            for (int i = 0; i < 4; ++i) {
+                CHECK(queue.try_emplace(round * 10 + i));
+            }
+            CHECK(queue.full());
+            CHECK(!queue.try_push(Tracked(-1)));
+            for (int i = 0; i < 4; ++i) {
+                std::optional<Tracked> item = queue.try_pop();
+                CHECK(item && *item->value == round * 10 + i);
+            }
+            CHECK(queue.empty());
+            CHECK(!queue.try_pop());
+        }
+        queue.push(Tracked(1));
+        queue.push(Tracked(2));
+        CHECK(Tracked::alive_num.load() == 2);
+    }
+    CHECK(Tracked::alive_num.load() == 0);
+}
+
+}  // namespace
+
+int main() {
+    RUN_TEST(TestMPMCBoundaries);
+    RUN_TEST(TestMPMCProducersConsumers);
+    RUN_TEST(TestMPMCNoMoreWakesConsumers);
+    RUN_TEST(TestQueueBulkOrder);
+    RUN_TEST(TestQueueMoveOnly);
+    RUN_TEST(TestQueuePopBulkTimeout);
+    RUN_TEST(TestQueueNoMoreWakesConsumers);
+    RUN_TEST(TestSPSCOrderWrapAround);
+    RUN_TEST(TestSPSCBoundaries);
+    return 0;
+}
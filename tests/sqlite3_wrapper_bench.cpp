@@ -0,0 +1,355 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "util/Sqlite3Wrapper.hpp"
+#include "BenchUtil.h"
+
+namespace {
+
+// 内存库中的kv表，k为主键，v为定长文本
+void CreateKvTable(SQLite3Wrapper &db, long long row_num) {
+    db.Execute("CREATE TABLE kv(k INTEGER PRIMARY KEY, v TEXT, n INTEGER)", NULL, NULL, NULL);
+    db.Begin();
+    SQLite3Stmt stmt = db.GetDBStmt("INSERT INTO kv VALUES(?, printf('value-%08d', ?1), ?1 % 97)");
+    for (long long i = 0; i < row_num; ++i) {
+        stmt.Bind((int64_t)i);
+        stmt.Step();
+        stmt.ResetStmt();
+    }
+    db.Commit();
+}
+
+// user-012: 按主键点查时每次GetDBStmt编译与GetCachedStmt从缓存借出的对比，两条SQL的长度不同，编译开销也不同
+void BenchStmtCache(double scale) {
+    const long long kQueryNum = Scaled(200000, scale);
+    const long long kRowNum = 10000;
+    SQLite3Wrapper db(":memory:");
+    db.OpenDB();
+    CreateKvTable(db, kRowNum);
+
+    const char *queries[] = {
+        "SELECT v FROM kv WHERE k = ?",
+        "SELECT a.v, b.v, a.n + b.n FROM kv a JOIN kv b ON b.k = (a.k * 7) % 10000 "
+        "WHERE a.k = ? AND a.n >= 0 AND b.n >= 0 ORDER BY a.k LIMIT 1",
+    };
+    for (const char *sql : queries) {
+        int64_t checksum[2] = {0, 0};
+        double prepare_ms = MeasureMs([&] {
+            for (long long i = 0; i < kQueryNum; ++i) {
+                SQLite3Stmt stmt = db.GetDBStmt(sql);
+                stmt.Bind((int64_t)(i % kRowNum));
+                if (stmt.Step() == SQLITE_ROW) {
+                    checksum[0] += stmt.GetColumnBytes(0);
+                }
+            }
+        });
+        double cached_ms = MeasureMs([&] {
+            for (long long i = 0; i < kQueryNum; ++i) {
+                SQLite3StmtLease stmt = db.GetCachedStmt(sql);
+                stmt->Bind((int64_t)(i % kRowNum));
+                if (stmt->Step() == SQLITE_ROW) {
+                    checksum[1] += stmt->GetColumnBytes(0);
+                }
+            }
+        });
+        if (checksum[0] != checksum[1]) {
+            printf("checksum mismatch\n");
+        }
+        printf("sql=%zu chars queries=%lld prepare per call %.0f ns/query, cached %.0f ns/query (%.1fx), hit %llu miss %llu\n",
+               strlen(sql), kQueryNum, prepare_ms * 1e6 / kQueryNum, cached_ms * 1e6 / kQueryNum, prepare_ms / cached_ms,
+               (unsigned long long)db.GetStmtCacheHitCount(), (unsigned long long)db.GetStmtCacheMissCount());
+    }
+}
+
+std::string TempDbPath(const std::string &name) {
+    std::string path = "sqlite3_wrapper_bench_" + name + ".db";
+    for (const char *suffix : {"", "-wal", "-shm", "-journal"}) {
+        std::remove((path + suffix).c_str());
+    }
+    return path;
+}
+
+// 打开WAL模式、synchronous=NORMAL的文件库并建表(i, s, f)
+void OpenWalTable(SQLite3Wrapper &db) {
+    db.OpenDB();
+    db.Execute("PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL; CREATE TABLE b(i INTEGER, s TEXT, f REAL)", NULL, NULL, NULL);
+}
+
+// user-013: WAL文件库上逐行自动提交、逐行插入一个事务、以及SQLite3BulkWriter不同rows_per_stmt/rows_per_commit的写入速度
+void BenchBulkWriter(double scale) {
+    const long long kRowNum = Scaled(500000, scale);
+    const long long kAutoCommitRowNum = Scaled(5000, scale);
+    std::string path = TempDbPath("bulk");
+    {
+        SQLite3Wrapper db(path);
+        OpenWalTable(db);
+        SQLite3Stmt stmt = db.GetDBStmt("INSERT INTO b VALUES(?, ?, ?)");
+        double ms = MeasureMs([&] {
+            for (long long i = 0; i < kAutoCommitRowNum; ++i) {
+                stmt.Bind((int64_t)i, "value" + std::to_string(i), i * 0.5);
+                stmt.Step();
+                stmt.ResetStmt();
+            }
+        });
+        printf("%-34s rows=%-7lld %.0f rows/s\n", "per-row autocommit", kAutoCommitRowNum, kAutoCommitRowNum / ms * 1000);
+    }
+    {
+        SQLite3Wrapper db(TempDbPath("bulk"));
+        OpenWalTable(db);
+        SQLite3Stmt stmt = db.GetDBStmt("INSERT INTO b VALUES(?, ?, ?)");
+        double ms = MeasureMs([&] {
+            db.Begin();
+            for (long long i = 0; i < kRowNum; ++i) {
+                stmt.Bind((int64_t)i, "value" + std::to_string(i), i * 0.5);
+                stmt.Step();
+                stmt.ResetStmt();
+            }
+            db.Commit();
+        });
+        printf("%-34s rows=%-7lld %.0f rows/s\n", "per-row, one transaction", kRowNum, kRowNum / ms * 1000);
+    }
+    for (size_t rows_per_commit : {(size_t)1000, SQLite3BulkWriter::kDefaultRowsPerCommit}) {
+        for (int rows_per_stmt : {1, 4, 16, 64}) {
+            SQLite3Wrapper db(TempDbPath("bulk"));
+            OpenWalTable(db);
+            double ms = MeasureMs([&] {
+                SQLite3BulkWriter writer(db, "INSERT INTO b(i, s, f) VALUES", 3);
+                writer.SetRowsPerStmt(rows_per_stmt);
+                writer.SetCommitPolicy(rows_per_commit, std::chrono::seconds(10));
+                for (long long i = 0; i < kRowNum; ++i) {
+                    writer.Add(i, "value" + std::to_string(i), i * 0.5);
+                }
+                writer.Flush();
+            });
+            char name[64];
+            snprintf(name, sizeof(name), "bulk stmt=%d commit=%zu", rows_per_stmt, rows_per_commit);
+            printf("%-34s rows=%-7lld %.0f rows/s\n", name, kRowNum, kRowNum / ms * 1000);
+        }
+    }
+    TempDbPath("bulk");
+}
+
+// user-014: 全表扫描路径文本和8字节哈希BLOB，GetColumnText/GetColumnBlob每行拷贝与视图/追加到复用缓冲区的对比
+void BenchColumnViews(double scale) {
+    const long long kRowNum = Scaled(10000000, scale);
+    SQLite3Wrapper db(":memory:");
+    db.OpenDB();
+    db.Execute("CREATE TABLE f(path TEXT, hash BLOB)", NULL, NULL, NULL);
+    db.Begin();
+    {
+        SQLite3Stmt stmt = db.GetDBStmt("INSERT INTO f VALUES(printf('/data/photos/%04d/IMG_%08d.jpg', ?1 / 1000, ?1), ?2)");
+        for (long long i = 0; i < kRowNum; ++i) {
+            int64_t hash = i * 0x9E3779B97F4A7C15LL;
+            stmt.Bind((int64_t)i, SQLite3ByteSpan((const unsigned char *)&hash, sizeof(hash)));
+            stmt.Step();
+            stmt.ResetStmt();
+        }
+    }
+    db.Commit();
+
+    SQLite3Stmt stmt = db.GetDBStmt("SELECT path, hash FROM f");
+    size_t checksum[3] = {0, 0, 0};
+    double copy_ms = MeasureMs([&] {
+        while (stmt.Step() == SQLITE_ROW) {
+            std::string path = stmt.GetColumnText(0);
+            std::vector<unsigned char> hash = stmt.GetColumnBlob(1);
+            checksum[0] += path.size() + hash[0];
+        }
+    });
+    stmt.ResetStmt();
+    double view_ms = MeasureMs([&] {
+        while (stmt.Step() == SQLITE_ROW) {
+            std::string_view path = stmt.GetColumnTextView(0);
+            SQLite3ByteSpan hash = stmt.GetColumnBlobView(1);
+            checksum[1] += path.size() + hash.data()[0];
+        }
+    });
+    stmt.ResetStmt();
+    std::string path;
+    std::vector<unsigned char> hash;
+    double append_ms = MeasureMs([&] {
+        while (stmt.Step() == SQLITE_ROW) {
+            path.clear();
+            hash.clear();
+            stmt.AppendColumnText(0, path);
+            stmt.AppendColumnBlob(1, hash);
+            checksum[2] += path.size() + hash[0];
+        }
+    });
+    if (checksum[0] != checksum[1] || checksum[0] != checksum[2]) {
+        printf("checksum mismatch\n");
+    }
+    printf("rows=%lld copy %.1f ns/row, view %.1f ns/row, append to reused buffer %.1f ns/row\n", kRowNum,
+           copy_ms * 1e6 / kRowNum, view_ms * 1e6 / kRowNum, append_ms * 1e6 / kRowNum);
+}
+
+// user-016: 手写的BindInt64/BindText/BindDouble和GetColumn*循环与Bind(...)、Rows<...>()的对比
+// 每种写法各在新的内存库上跑3次，交替进行，取最快的一次
+void BenchTypedRows(double scale) {
+    const long long kRowNum = Scaled(1000000, scale);
+    const std::string text = "some/relative/path.jpg";
+    double best_ms[4] = {1e300, 1e300, 1e300, 1e300};
+    double sum[2] = {0, 0};
+    for (int round = 0; round < 6; ++round) {
+        bool is_typed = (round + round / 2) % 2 == 1;
+        SQLite3Wrapper db(":memory:");
+        db.OpenDB();
+        db.Execute("CREATE TABLE t(i INTEGER, s TEXT, f REAL)", NULL, NULL, NULL);
+        SQLite3Stmt insert_stmt = db.GetDBStmt("INSERT INTO t VALUES(?, ?, ?)");
+        db.Begin();
+        double insert_ms = MeasureMs([&] {
+            for (long long i = 0; i < kRowNum; ++i) {
+                if (is_typed) {
+                    insert_stmt.Bind((int64_t)i, text, i * 0.5);
+                } else {
+                    insert_stmt.BindInt64(1, i);
+                    insert_stmt.BindText(2, text, SQLITE_STATIC);
+                    insert_stmt.BindDouble(3, i * 0.5);
+                }
+                insert_stmt.Step();
+                insert_stmt.ResetStmt();
+            }
+        });
+        db.Commit();
+
+        SQLite3Stmt select_stmt = db.GetDBStmt("SELECT i, s, f FROM t");
+        double row_sum = 0;
+        double scan_ms = MeasureMs([&] {
+            if (is_typed) {
+                for (auto [i, s, f] : select_stmt.Rows<int64_t, std::string_view, double>()) {
+                    row_sum += i + s.size() + f;
+                }
+            } else {
+                while (select_stmt.Step() == SQLITE_ROW) {
+                    row_sum += select_stmt.GetColumnInt64(0) + select_stmt.GetColumnTextView(1).size() + select_stmt.GetColumnDouble(2);
+                }
+            }
+        });
+        sum[is_typed] = row_sum;
+        best_ms[is_typed] = std::min(best_ms[is_typed], insert_ms);
+        best_ms[2 + is_typed] = std::min(best_ms[2 + is_typed], scan_ms);
+    }
+    if (sum[0] != sum[1]) {
+        printf("checksum mismatch\n");
+    }
+    printf("rows=%lld insert: manual binds %.1f ns/row, Bind(...) %.1f ns/row; scan: manual GetColumn* %.1f ns/row, Rows<> %.1f ns/row\n",
+           kRowNum, best_ms[0] * 1e6 / kRowNum, best_ms[1] * 1e6 / kRowNum, best_ms[2] * 1e6 / kRowNum, best_ms[3] * 1e6 / kRowNum);
+}
+
+// 返回已排序样本的p分位值
+double Percentile(std::vector<double> &samples, double p) {
+    if (samples.empty()) {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t index = std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()));
+    return samples[index];
+}
+
+// user-018: WAL、synchronous=FULL的文件库上，调用线程逐行自动提交与投递到SQLite3AsyncWriter的对比
+// latency为调用线程每次写入(或Post)花费的时间，rows/s包括等待最后一次提交完成
+void BenchAsyncWriter(double scale) {
+    const long long kSyncRowNum = Scaled(2000, scale);
+    const long long kAsyncRowNum = Scaled(200000, scale);
+    {
+        SQLite3Wrapper db(TempDbPath("async"));
+        db.OpenDB();
+        db.Execute("PRAGMA journal_mode=WAL; PRAGMA synchronous=FULL; CREATE TABLE w(i INTEGER, s TEXT)", NULL, NULL, NULL);
+        SQLite3Stmt stmt = db.GetDBStmt("INSERT INTO w VALUES(?, ?)");
+        std::vector<double> latency_us;
+        auto start = std::chrono::steady_clock::now();
+        for (long long i = 0; i < kSyncRowNum; ++i) {
+            auto op_start = std::chrono::steady_clock::now();
+            stmt.Bind((int64_t)i, "value" + std::to_string(i));
+            stmt.Step();
+            stmt.ResetStmt();
+            latency_us.push_back(ElapsedMs(op_start) * 1000);
+        }
+        double ms = ElapsedMs(start);
+        printf("%-26s rows=%-7lld %9.0f rows/s, latency p50 %.1f us, p99 %.1f us\n", "sync per-row autocommit",
+               kSyncRowNum, kSyncRowNum / ms * 1000, Percentile(latency_us, 0.5), Percentile(latency_us, 0.99));
+    }
+    for (int interval_ms : {0, 100}) {
+        SQLite3Wrapper db(TempDbPath("async"));
+        db.OpenDB();
+        db.Execute("PRAGMA journal_mode=WAL; PRAGMA synchronous=FULL; CREATE TABLE w(i INTEGER, s TEXT)", NULL, NULL, NULL);
+        SQLite3AsyncWriter writer(db);
+        writer.SetCommitPolicy(SQLite3AsyncWriter::kDefaultOpsPerCommit, std::chrono::milliseconds(interval_ms));
+        writer.Start();
+        std::vector<double> latency_us;
+        latency_us.reserve(kAsyncRowNum);
+        auto start = std::chrono::steady_clock::now();
+        for (long long i = 0; i < kAsyncRowNum; ++i) {
+            auto op_start = std::chrono::steady_clock::now();
+            writer.Post([i](SQLite3Wrapper &conn) {
+                SQLite3StmtLease stmt = conn.GetCachedStmt("INSERT INTO w VALUES(?, ?)");
+                stmt->Bind((int64_t)i, "value" + std::to_string(i));
+                return stmt->Step();
+            });
+            latency_us.push_back(ElapsedMs(op_start) * 1000);
+        }
+        int ret = writer.Flush().get();
+        double ms = ElapsedMs(start);
+        writer.Stop();
+        char name[64];
+        snprintf(name, sizeof(name), "async interval=%dms", interval_ms);
+        printf("%-26s rows=%-7lld %9.0f rows/s, latency p50 %.1f us, p99 %.1f us%s\n", name, kAsyncRowNum,
+               kAsyncRowNum / ms * 1000, Percentile(latency_us, 0.5), Percentile(latency_us, 0.99),
+               ret == SQLITE_OK ? "" : ", flush failed");
+    }
+    TempDbPath("async");
+}
+
+// user-023: kv表全表扫描，逐行Step读取与FetchBatch按列批量读取的对比，批次大小从1到4096
+void BenchFetchBatch(double scale) {
+    const long long kRowNum = Scaled(2000000, scale);
+    SQLite3Wrapper db(":memory:");
+    db.OpenDB();
+    CreateKvTable(db, kRowNum);
+
+    SQLite3Stmt stmt = db.GetDBStmt("SELECT k, v, n FROM kv");
+    int64_t expected = 0;
+    double row_ms = MeasureMs([&] {
+        while (stmt.Step() == SQLITE_ROW) {
+            expected += stmt.GetColumnInt64(0) + (int64_t)stmt.GetColumnTextView(1).size() + stmt.GetColumnInt64(2);
+        }
+    });
+    printf("%-16s rows=%lld %6.1f ns/row\n", "per-row Step", kRowNum, row_ms * 1e6 / kRowNum);
+
+    for (size_t capacity : {1, 16, 64, 256, 1024, 4096}) {
+        stmt.ResetStmt();
+        SQLite3ColumnBatch batch({SQLITE_INTEGER, SQLITE_TEXT, SQLITE_INTEGER}, capacity);
+        int64_t checksum = 0;
+        double batch_ms = MeasureMs([&] {
+            while (size_t n = stmt.FetchBatch(batch)) {
+                const int64_t *keys = batch.GetInt64Column(0);
+                const int64_t *nums = batch.GetInt64Column(2);
+                for (size_t r = 0; r < n; ++r) {
+                    checksum += keys[r] + (int64_t)batch.GetText(1, r).size() + nums[r];
+                }
+            }
+        });
+        char name[32];
+        snprintf(name, sizeof(name), "batch=%zu", capacity);
+        printf("%-16s rows=%lld %6.1f ns/row (%.2fx per-row)%s\n", name, kRowNum, batch_ms * 1e6 / kRowNum,
+               row_ms / batch_ms, checksum == expected ? "" : ", checksum mismatch");
+    }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    double scale = BenchScale(argc, argv);
+    RUN_BENCH(BenchStmtCache, scale);
+    RUN_BENCH(BenchBulkWriter, scale);
+    RUN_BENCH(BenchColumnViews, scale);
+    RUN_BENCH(BenchTypedRows, scale);
+    RUN_BENCH(BenchAsyncWriter, scale);
+    RUN_BENCH(BenchFetchBatch, scale);
+    return 0;
+}
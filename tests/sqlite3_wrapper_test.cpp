@@ -0,0 +1,1076 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <string>
+#include <vector>
+
+#include "util/Sqlite3Wrapper.hpp"
+#include "TestUtil.h"
+
+namespace {
+
+std::string TempDbPath(const std::string &name) {
+    std::string path = "sqlite3_wrapper_test_" + name + ".db";
+    for (const char *suffix : {"", "-wal", "-shm", "-journal"}) {
+        std::remove((path + suffix).c_str());
+    }
+    return path;
+}
+
+double CpuMs() {
+    return 1000.0 * std::clock() / CLOCKS_PER_SEC;
+}
+
+// user-023: 各种列类型的列式读取，包括BLOB、NULL以及声明为NULL的列
+void TestFetchBatch() {
+    SQLite3Wrapper db(":memory:");
+    CHECK(db.OpenDB() == SQLITE_OK);
+    CHECK(db.Execute("CREATE TABLE t(i INTEGER, f REAL, s TEXT, b BLOB, n)", NULL, NULL, NULL) == SQLITE_OK);
+    {
+        SQLite3Stmt stmt = db.GetDBStmt("INSERT INTO t VALUES(?, ?, ?, ?, ?)");
+        for (int i = 0; i < 10; ++i) {
+            std::vector<unsigned char> blob(i, (unsigned char)i);
+            if (i % 3 == 0) {
+                CHECK(stmt.Bind(nullptr, nullptr, nullptr, nullptr, nullptr) == SQLITE_OK);
+            } else {
+                CHECK(stmt.Bind((int64_t)i, i * 0.5, "row" + std::to_string(i), blob, i) == SQLITE_OK);
+            }
+            CHECK(stmt.Step() == SQLITE_DONE);
+            CHECK(stmt.ResetStmt() == SQLITE_OK);
+        }
+    }
+
+    SQLite3Stmt stmt = db.GetDBStmt("SELECT i, f, s, b, n FROM t ORDER BY rowid");
+    SQLite3ColumnBatch batch({SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB, SQLITE_NULL}, 4);
+    int row = 0;
+    size_t n = 0;
+    while ((n = stmt.FetchBatch(batch)) > 0) {
+        for (size_t r = 0; r < n; ++r, ++row) {
+            bool is_null = row % 3 == 0;
+            for (int col = 0; col < 5; ++col) {
+                CHECK(batch.IsNull(col, r) == is_null);
+            }
+            if (is_null) {
+                CHECK(batch.GetInt64Column(0)[r] == 0);
+                CHECK(batch.GetText(2, r).empty());
+                CHECK(batch.GetBlob(3, r).empty());
+                continue;
+            }
+            CHECK(batch.GetInt64Column(0)[r] == row);
+            CHECK(batch.GetDoubleColumn(1)[r] == row * 0.5);
+            CHECK(batch.GetText(2, r) == "row" + std::to_string(row));
+            SQLite3ByteSpan blob = batch.GetBlob(3, r);
+            CHECK(blob.size() == (size_t)row);
+            for (unsigned char c : blob) {
+                CHECK(c == row);
+            }
+        }
+    }
+    CHECK(row == 10);
+    CHECK(stmt.Status() == SQLITE_DONE);
+    CHECK(stmt.FetchBatch(batch) == 0);
+}
+
+sqlite3_mem_methods g_default_mem;
+std::atomic<int> g_fail_alloc_size{0};
+
+// 开启后不小于g_fail_alloc_size的分配全部失败，用于模拟内存不足
+void *FailingMalloc(int n) {
+    int fail_size = g_fail_alloc_size.load();
+    return fail_size > 0 && n >= fail_size ? nullptr : g_default_mem.xMalloc(n);
+}
+
+void *FailingRealloc(void *p, int n) {
+    int fail_size = g_fail_alloc_size.load();
+    return fail_size > 0 && n >= fail_size ? nullptr : g_default_mem.xRealloc(p, n);
+}
+
+// sqlite3_config只能在sqlite3_initialize之前调用，调用时不能有打开的连接
+void SetFailingAllocator(bool is_enable) {
+    CHECK(sqlite3_shutdown() == SQLITE_OK);
+    if (is_enable) {
+        CHECK(sqlite3_config(SQLITE_CONFIG_GETMALLOC, &g_default_mem) == SQLITE_OK);
+        sqlite3_mem_methods methods = g_default_mem;
+        methods.xMalloc = FailingMalloc;
+        methods.xRealloc = FailingRealloc;
+        CHECK(sqlite3_config(SQLITE_CONFIG_MALLOC, &methods) == SQLITE_OK);
+    } else {
+        CHECK(sqlite3_config(SQLITE_CONFIG_MALLOC, &g_default_mem) == SQLITE_OK);
+    }
+    CHECK(sqlite3_initialize() == SQLITE_OK);
+}
+
+// user-023: 读取文本时内存不足，FetchBatch返回已读的行并把Status()置为SQLITE_NOMEM，没读成功的那一行在下次调用时返回
+void TestFetchBatchNoMem() {
+    SetFailingAllocator(true);
+    {
+        SQLite3Wrapper db(":memory:");
+        CHECK(db.OpenDB() == SQLITE_OK);
+        // UTF-16的库中Step把文本按原编码复制一份(约2000字节)，按UTF-8读取时再转换编码，分配约4000字节
+        CHECK(db.Execute("PRAGMA encoding='UTF-16le'; CREATE TABLE t(i INTEGER, s TEXT)", NULL, NULL, NULL) == SQLITE_OK);
+        const std::string big(1000, 'x');
+        {
+            SQLite3Stmt stmt = db.GetDBStmt("INSERT INTO t VALUES(?, ?)");
+            for (int i = 0; i < 5; ++i) {
+                CHECK(stmt.Bind(i, i == 2 ? big : "row" + std::to_string(i)) == SQLITE_OK);
+                CHECK(stmt.Step() == SQLITE_DONE);
+                CHECK(stmt.ResetStmt() == SQLITE_OK);
+            }
+        }
+
+        SQLite3Stmt stmt = db.GetDBStmt("SELECT i, s FROM t ORDER BY rowid");
+        SQLite3ColumnBatch batch({SQLITE_INTEGER, SQLITE_TEXT}, 10);
+        g_fail_alloc_size.store(3000);
+        size_t n = stmt.FetchBatch(batch);
+        g_fail_alloc_size.store(0);
+        CHECK(n == 2);
+        CHECK(stmt.Status() == SQLITE_NOMEM);
+        CHECK(batch.GetInt64Column(0)[1] == 1);
+
+        // 没有追加的那一行在下次调用时读出；SQLite中止了读列失败的语句，之后的Step返回SQLITE_NOMEM
+        CHECK(stmt.FetchBatch(batch) == 1);
+        CHECK(batch.GetInt64Column(0)[0] == 2);
+        CHECK(batch.GetText(1, 0) == big);
+        CHECK(stmt.Status() == SQLITE_NOMEM);
+
+        stmt.ResetStmt();
+        CHECK(stmt.FetchBatch(batch) == 5);
+        CHECK(batch.GetText(1, 2) == big);
+        CHECK(batch.GetText(1, 4) == "row4");
+        CHECK(stmt.Status() == SQLITE_DONE);
+        CHECK(stmt.FetchBatch(batch) == 0);
+    }
+    SetFailingAllocator(false);
+}
+
+int CountRows(SQLite3Wrapper &db, const std::string &table) {
+    SQLite3Stmt stmt = db.GetDBStmt("SELECT count(*) FROM " + table);
+    CHECK(stmt.Step() == SQLITE_ROW);
+    return stmt.GetColumn<int>(0);
+}
+
+// user-017: 32个线程反复打开连接、编译语句、关闭连接，部分语句在CloseDB之后才析构，
+// 部分语句交给其它线程析构；配合-DUTIL_TEST_SANITIZER=address/thread检查语句和连接状态的生命周期
+void TestConnStateStress() {
+    std::string path = TempDbPath("stress");
+    {
+        SQLite3Wrapper db(path);
+        CHECK(db.OpenDB() == SQLITE_OK);
+        CHECK(db.Execute("PRAGMA journal_mode=WAL; CREATE TABLE t(v INTEGER); INSERT INTO t VALUES(1)", NULL, NULL, NULL) == SQLITE_OK);
+    }
+
+    const int kThreadNum = 32;
+    const int kRoundNum = 50;
+    std::mutex orphan_mutex;
+    std::vector<SQLite3Stmt> orphan_stmts;
+    std::atomic<int> error_num{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreadNum; ++t) {
+        threads.emplace_back([&, t] {
+            for (int round = 0; round < kRoundNum; ++round) {
+                SQLite3Wrapper db(path);
+                if (db.OpenDB() != SQLITE_OK || db.SetBusyTimeout(5000) != SQLITE_OK) {
+                    ++error_num;
+                    continue;
+                }
+
+                SQLite3Stmt select_stmt = db.GetDBStmt("SELECT v FROM t");
+                if (select_stmt.Step() != SQLITE_ROW || select_stmt.GetColumn<int>(0) != 1) {
+                    ++error_num;
+                }
+                {
+                    SQLite3StmtLease lease = db.GetCachedStmt("SELECT count(*) FROM t");
+                    if (lease->Step() != SQLITE_ROW) {
+                        ++error_num;
+                    }
+                }
+                SQLite3Stmt moved_stmt;
+                moved_stmt = db.GetDBStmt("SELECT v + ? FROM t");
+                moved_stmt.Bind(round);
+                SQLite3Stmt finalized_stmt = db.GetDBStmt("SELECT 1");
+                finalized_stmt.Finalize();
+
+                // 关闭连接时select_stmt和moved_stmt还没有析构
+                if (db.CloseDB() != SQLITE_OK) {
+                    ++error_num;
+                }
+                if ((t + round) % 4 == 0) {
+                    std::lock_guard<std::mutex> lock(orphan_mutex);
+                    orphan_stmts.push_back(std::move(moved_stmt));
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    CHECK(error_num.load() == 0);
+    CHECK(orphan_stmts.size() == kThreadNum * kRoundNum / 4);
+    orphan_stmts.clear();
+}
+
+// user-017: 没有连接状态的语句在Finalize时也要finalize，否则sqlite3_close因语句未释放返回SQLITE_BUSY
+void TestFinalizeWithoutConnState() {
+    sqlite3 *db = nullptr;
+    CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    {
+        SQLite3Stmt stmt("SELECT 1");
+        CHECK(stmt.Prepare(db, nullptr, nullptr) == SQLITE_OK);
+        CHECK(stmt.Step() == SQLITE_ROW);
+        SQLite3Stmt moved(std::move(stmt));
+        CHECK(moved.Finalize() == SQLITE_OK);
+    }
+    {
+        // 析构时同样finalize
+        SQLite3Stmt stmt("SELECT 2");
+        CHECK(stmt.Prepare(db, nullptr, nullptr) == SQLITE_OK);
+    }
+    CHECK(sqlite3_next_stmt(db, nullptr) == nullptr);
+    CHECK(sqlite3_close(db) == SQLITE_OK);
+}
+
+// user-011: 连接借出和归还，只读连接用完后TryAcquireReader返回空，AcquireReader/AcquireWriter阻塞到有连接归还
+void TestPoolLease() {
+    std::string path = TempDbPath("pool");
+    SQLite3Pool pool(path, 2);
+    CHECK(!pool.IsOpen());
+    CHECK(!pool.AcquireReader());
+    CHECK(pool.Open() == SQLITE_OK);
+    CHECK(pool.IsOpen());
+    CHECK(pool.Open() == SQLITE_MISUSE);
+    {
+        SQLite3Pool::Lease writer = pool.AcquireWriter();
+        CHECK(writer);
+        CHECK(writer->Execute("CREATE TABLE t(v INTEGER); INSERT INTO t VALUES(1)", NULL, NULL, NULL) == SQLITE_OK);
+    }
+
+    SQLite3Pool::Lease first = pool.TryAcquireReader();
+    SQLite3Pool::Lease second = pool.TryAcquireReader();
+    CHECK(first && second);
+    CHECK(&*first != &*second);
+    CHECK(!pool.TryAcquireReader());
+    // 只读连接上写入失败，读到写连接提交的数据
+    CHECK(first->Execute("INSERT INTO t VALUES(2)", NULL, NULL, NULL) == SQLITE_READONLY);
+    CHECK(CountRows(*second, "t") == 1);
+
+    // 归还后优先借出刚归还的连接
+    SQLite3Wrapper *second_db = &*second;
+    second.Release();
+    CHECK(!second);
+    SQLite3Pool::Lease again = pool.TryAcquireReader();
+    CHECK(again && &*again == second_db);
+
+    std::atomic<bool> is_acquired{false};
+    std::thread reader_thread([&] {
+        SQLite3Pool::Lease lease = pool.AcquireReader();
+        CHECK(lease);
+        is_acquired.store(true);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(!is_acquired.load());
+    // 移动赋值会先归还原来的连接
+    first = SQLite3Pool::Lease();
+    reader_thread.join();
+    CHECK(is_acquired.load());
+
+    SQLite3Pool::Lease writer = pool.AcquireWriter();
+    is_acquired.store(false);
+    std::thread writer_thread([&] {
+        SQLite3Pool::Lease lease = pool.AcquireWriter();
+        CHECK(lease);
+        is_acquired.store(true);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(!is_acquired.load());
+    SQLite3Pool::Lease moved_writer(std::move(writer));
+    CHECK(!writer && moved_writer);
+    moved_writer.Release();
+    writer_thread.join();
+    CHECK(is_acquired.load());
+
+    // Close等到所有连接归还后才关闭，之后借出的都是空的Lease
+    std::atomic<bool> is_closed{false};
+    std::thread close_thread([&] {
+        pool.Close();
+        is_closed.store(true);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(!is_closed.load());
+    again.Release();
+    close_thread.join();
+    CHECK(!pool.IsOpen());
+    CHECK(!pool.AcquireWriter());
+    CHECK(!pool.TryAcquireReader());
+}
+
+int CountPreparedStmts(sqlite3 *db) {
+    int num = 0;
+    for (sqlite3_stmt *stmt = sqlite3_next_stmt(db, nullptr); stmt; stmt = sqlite3_next_stmt(db, stmt)) {
+        ++num;
+    }
+    return num;
+}
+
+// user-012: 第二次借出同一条SQL命中缓存，借出的语句已经重置并清空绑定；同一条SQL同时借出两次时第二个单独编译
+void TestStmtCacheHitMiss() {
+    SQLite3Wrapper db(":memory:");
+    CHECK(db.OpenDB() == SQLITE_OK);
+    {
+        SQLite3StmtLease lease = db.GetCachedStmt("SELECT ?");
+        CHECK(lease && lease->Status() == SQLITE_OK);
+        CHECK(lease->Bind(42) == SQLITE_OK);
+        CHECK(lease->Step() == SQLITE_ROW);
+        CHECK(lease->GetColumn<int>(0) == 42);
+    }
+    CHECK(db.GetStmtCacheMissCount() == 1);
+    CHECK(db.GetStmtCacheHitCount() == 0);
+
+    SQLite3Stmt *cached = nullptr;
+    {
+        SQLite3StmtLease lease = db.GetCachedStmt("SELECT ?");
+        cached = &*lease;
+        CHECK(db.GetStmtCacheHitCount() == 1);
+        CHECK(lease->Step() == SQLITE_ROW);
+        CHECK(lease->GetColumnType(0) == SQLITE_NULL);
+
+        SQLite3StmtLease duplicate = db.GetCachedStmt("SELECT ?");
+        CHECK(duplicate && &*duplicate != cached);
+        CHECK(db.GetStmtCacheMissCount() == 2);
+    }
+    {
+        SQLite3StmtLease lease = db.GetCachedStmt("SELECT ?");
+        CHECK(&*lease == cached);
+        CHECK(db.GetStmtCacheHitCount() == 2);
+    }
+
+    // 编译失败的语句不进入缓存
+    {
+        SQLite3StmtLease lease = db.GetCachedStmt("SELEC 1");
+        CHECK(lease && lease->Status() != SQLITE_OK);
+    }
+    SQLite3StmtLease lease = db.GetCachedStmt("SELEC 1");
+    CHECK(db.GetStmtCacheMissCount() == 4);
+}
+
+// user-012: 超过容量时淘汰最久没有使用的语句并finalize，借出中的语句不会被淘汰
+void TestStmtCacheEviction() {
+    sqlite3 *db = nullptr;
+    CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    {
+        auto cache = std::make_shared<SQLite3StmtCache>(2);
+        auto acquire = [&](const std::string &sql) {
+            return SQLite3StmtLease(cache, cache->Acquire(db, nullptr, sql));
+        };
+        acquire("SELECT 1");
+        acquire("SELECT 2");
+        acquire("SELECT 1");
+        CHECK(cache->HitCount() == 1);
+        // SELECT 2最久没有使用，被SELECT 3挤出
+        acquire("SELECT 3");
+        CHECK(cache->Size() == 2);
+        CHECK(CountPreparedStmts(db) == 2);
+        acquire("SELECT 1");
+        CHECK(cache->HitCount() == 2);
+        acquire("SELECT 2");
+        CHECK(cache->HitCount() == 2);
+        CHECK(cache->MissCount() == 4);
+
+        {
+            SQLite3StmtLease in_use = acquire("SELECT 2");
+            cache->SetCapacity(0);
+            CHECK(cache->Size() == 1);
+            CHECK(CountPreparedStmts(db) == 1);
+            CHECK(in_use->Step() == SQLITE_ROW);
+        }
+        CHECK(cache->Size() == 0);
+        CHECK(CountPreparedStmts(db) == 0);
+
+        // 缓存清空后归还的语句直接finalize
+        cache->SetCapacity(2);
+        SQLite3StmtLease lease = acquire("SELECT 4");
+        cache->Clear();
+        CHECK(CountPreparedStmts(db) == 1);
+        lease.Release();
+        CHECK(CountPreparedStmts(db) == 0);
+    }
+    CHECK(sqlite3_close(db) == SQLITE_OK);
+}
+
+// user-013: 凑满rows_per_stmt的行立即写入，不满一批的剩余行只在Flush(或析构)时写入；提交之前其它连接看不到
+void TestBulkWriterFlush() {
+    std::string path = TempDbPath("bulk");
+    SQLite3Wrapper db(path);
+    CHECK(db.OpenDB() == SQLITE_OK);
+    CHECK(db.Execute("PRAGMA journal_mode=WAL; CREATE TABLE b(i INTEGER PRIMARY KEY, f REAL, s TEXT, x BLOB)", NULL, NULL, NULL) == SQLITE_OK);
+    SQLite3Wrapper reader(path);
+    CHECK(reader.OpenDB() == SQLITE_OK);
+
+    {
+        SQLite3BulkWriter writer(db, "INSERT INTO b(i, f, s, x) VALUES", 4);
+        writer.SetCommitPolicy(10000, std::chrono::hours(1));
+        CHECK(writer.SetRowsPerStmt(16) == SQLITE_OK);
+        CHECK(writer.GetRowsPerStmt() == 16);
+        CHECK(writer.Add(1, 2) == SQLITE_RANGE);
+
+        std::vector<unsigned char> blob{1, 2, 3};
+        for (int i = 0; i < 40; ++i) {
+            int ret = i % 5 == 0 ? writer.Add(i, nullptr, nullptr, nullptr)
+                                 : writer.Add(i, i * 0.5, "s" + std::to_string(i), SQLite3ByteSpan(blob.data(), blob.size()));
+            CHECK(ret == SQLITE_OK);
+        }
+        // 两批共32行已经写入，剩余8行还在缓存中
+        CHECK(writer.GetWrittenRowNum() == 32);
+        CHECK(CountRows(db, "b") == 32);
+        CHECK(CountRows(reader, "b") == 0);
+
+        CHECK(writer.Flush() == SQLITE_OK);
+        CHECK(writer.GetWrittenRowNum() == 40);
+        CHECK(CountRows(reader, "b") == 40);
+
+        // 剩余的行在析构时写入并提交
+        CHECK(writer.Add(100, 1.5, std::string_view("tail"), nullptr) == SQLITE_OK);
+        CHECK(writer.GetWrittenRowNum() == 40);
+    }
+    CHECK(CountRows(reader, "b") == 41);
+
+    SQLite3Stmt stmt = reader.GetDBStmt("SELECT f, s, x FROM b WHERE i = ?");
+    CHECK(stmt.Bind(7) == SQLITE_OK);
+    CHECK(stmt.Step() == SQLITE_ROW);
+    CHECK(stmt.GetColumn<double>(0) == 3.5);
+    CHECK(stmt.GetColumnTextView(1) == "s7");
+    CHECK(stmt.GetColumnBytes(2) == 3);
+    CHECK(stmt.ResetStmt() == SQLITE_OK);
+    CHECK(stmt.Bind(10) == SQLITE_OK);
+    CHECK(stmt.Step() == SQLITE_ROW);
+    CHECK(stmt.GetColumnType(1) == SQLITE_NULL);
+    CHECK(stmt.ResetStmt() == SQLITE_OK);
+
+    // 达到rows_per_commit时在Add中提交，insert_tail使重复的主键被忽略
+    {
+        SQLite3BulkWriter writer(db, "INSERT INTO b(i, s) VALUES", 2, "ON CONFLICT(i) DO NOTHING");
+        writer.SetCommitPolicy(10, std::chrono::hours(1));
+        CHECK(writer.SetRowsPerStmt(4) == SQLITE_OK);
+        for (int i = 35; i < 45; ++i) {
+            CHECK(writer.Add(i, "dup") == SQLITE_OK);
+        }
+        CHECK(writer.GetWrittenRowNum() == 10);
+        CHECK(CountRows(reader, "b") == 46);
+        CHECK(writer.Add(45, "pending") == SQLITE_OK);
+        CHECK(CountRows(reader, "b") == 46);
+    }
+    CHECK(CountRows(reader, "b") == 47);
+    CHECK(CountRows(reader, "b WHERE s = 'dup'") == 5);
+}
+
+// user-014: 视图直接指向SQLite的缓冲区，长度来自sqlite3_column_bytes(文本中间可以有'\0')；
+// NULL返回空视图，Append系列追加到调用方的缓冲区后面
+void TestColumnViews() {
+    SQLite3Wrapper db(":memory:");
+    CHECK(db.OpenDB() == SQLITE_OK);
+    SQLite3Stmt stmt = db.GetDBStmt("SELECT ?, ?, ?, NULL, '', zeroblob(0)");
+    std::string text("a\0b", 3);
+    std::vector<unsigned char> blob{0, 1, 2, 255};
+    CHECK(stmt.Bind(text, blob, "tail") == SQLITE_OK);
+    CHECK(stmt.Step() == SQLITE_ROW);
+
+    std::string_view text_view = stmt.GetColumnTextView(0);
+    CHECK(text_view == text);
+    CHECK(text_view.data() == stmt.GetColumnTextView(0).data());
+    SQLite3ByteSpan blob_view = stmt.GetColumnBlobView(1);
+    CHECK(blob_view.size() == blob.size());
+    CHECK(std::vector<unsigned char>(blob_view.begin(), blob_view.end()) == blob);
+    CHECK(blob_view.data() == stmt.GetColumnBlobView(1).data());
+    CHECK(stmt.GetColumn<std::string_view>(2) == "tail");
+    CHECK(stmt.GetColumn<SQLite3ByteSpan>(1).data() == blob_view.data());
+
+    // NULL、空字符串和空BLOB都是空视图
+    CHECK(stmt.GetColumnTextView(3).empty() && stmt.GetColumnTextView(3).data() == nullptr);
+    CHECK(stmt.GetColumnBlobView(3).size() == 0);
+    CHECK(stmt.GetColumnTextView(4).empty());
+    CHECK(stmt.GetColumnBlobView(5).size() == 0);
+
+    std::string text_out = "prefix:";
+    CHECK(stmt.AppendColumnText(0, text_out) == 3);
+    CHECK(stmt.AppendColumnText(2, text_out) == 4);
+    CHECK(stmt.AppendColumnText(3, text_out) == 0);
+    CHECK(text_out == std::string("prefix:a\0btail", 14));
+    std::vector<unsigned char> blob_out{9};
+    CHECK(stmt.AppendColumnBlob(1, blob_out) == 4);
+    CHECK(stmt.AppendColumnBlob(5, blob_out) == 0);
+    CHECK((blob_out == std::vector<unsigned char>{9, 0, 1, 2, 255}));
+
+    // 拷贝版本的结果与视图一致
+    CHECK(stmt.GetColumnText(2) == "tail");
+    CHECK(stmt.GetColumnBlob(1) == blob);
+    CHECK(stmt.Step() == SQLITE_DONE);
+}
+
+// user-015: 转移给语句的参数在ResetStmt之后仍然有效(SQLite在reset时保留绑定)，语句移动后也不失效；
+// 重新绑定同一位置或ClearBindings时才释放。配合-DUTIL_TEST_SANITIZER=address检查
+void TestMoveInBinds() {
+    SQLite3Wrapper db(":memory:");
+    CHECK(db.OpenDB() == SQLITE_OK);
+    std::string expected_text(1000, 'x');
+    std::vector<unsigned char> expected_blob(1000, 0xAB);
+
+    SQLite3Stmt stmt = db.GetDBStmt("SELECT ?, ?, ?");
+    {
+        std::string text = expected_text;
+        std::vector<unsigned char> blob = expected_blob;
+        std::string transient = "transient";
+        CHECK(stmt.BindText(1, std::move(text)) == SQLITE_OK);
+        CHECK(stmt.BindBlob(2, std::move(blob)) == SQLITE_OK);
+        CHECK(stmt.BindText(3, transient, SQLITE_TRANSIENT) == SQLITE_OK);
+        CHECK(text.empty() && blob.empty());
+        CHECK(stmt.Step() == SQLITE_ROW);
+        CHECK(stmt.ResetStmt() == SQLITE_OK);
+    }
+
+    // 调用方的变量已经析构，reset之后再执行读到的仍然是转移进来的数据
+    for (int round = 0; round < 2; ++round) {
+        CHECK(stmt.Step() == SQLITE_ROW);
+        CHECK(stmt.GetColumnTextView(0) == expected_text);
+        CHECK(stmt.GetColumnBlob(1) == expected_blob);
+        CHECK(stmt.GetColumnTextView(2) == "transient");
+        CHECK(stmt.ResetStmt() == SQLITE_OK);
+    }
+
+    SQLite3Stmt moved(std::move(stmt));
+    CHECK(moved.Step() == SQLITE_ROW);
+    CHECK(moved.GetColumnTextView(0) == expected_text);
+    CHECK(moved.ResetStmt() == SQLITE_OK);
+
+    // 同一位置重新转移时替换原来的数据，另一位置不受影响
+    CHECK(moved.BindText(1, std::string("second")) == SQLITE_OK);
+    CHECK(moved.Step() == SQLITE_ROW);
+    CHECK(moved.GetColumnTextView(0) == "second");
+    CHECK(moved.GetColumnBlob(1) == expected_blob);
+    CHECK(moved.ResetStmt() == SQLITE_OK);
+
+    CHECK(moved.ClearBindings() == SQLITE_OK);
+    CHECK(moved.Step() == SQLITE_ROW);
+    CHECK(moved.GetColumnType(0) == SQLITE_NULL);
+    CHECK(moved.GetColumnType(1) == SQLITE_NULL);
+    CHECK(moved.ResetStmt() == SQLITE_OK);
+
+    CHECK(moved.BindText(4, std::string("out of range")) == SQLITE_RANGE);
+    CHECK(moved.BindBlob(0, std::vector<unsigned char>{1}) == SQLITE_RANGE);
+}
+
+// user-016: Bind按参数类型选择sqlite3_bind_*，Rows按Ts逐行读成tuple，NULL列读成std::nullopt
+void TestTypedRowsAndBind() {
+    SQLite3Wrapper db(":memory:");
+    CHECK(db.OpenDB() == SQLITE_OK);
+    CHECK(db.Execute("CREATE TABLE r(i INTEGER, s TEXT, f REAL, o INTEGER, b BLOB)", NULL, NULL, NULL) == SQLITE_OK);
+    {
+        SQLite3Stmt stmt = db.GetDBStmt("INSERT INTO r VALUES(?, ?, ?, ?, ?)");
+        CHECK(stmt.Bind((int64_t)1 << 40, "text", 1.5f, std::optional<int>(7), std::vector<unsigned char>{1, 2}) == SQLITE_OK);
+        CHECK(stmt.Step() == SQLITE_DONE);
+        CHECK(stmt.ResetStmt() == SQLITE_OK);
+        std::string_view view("view");
+        CHECK(stmt.Bind((short)-2, view, 2.25, std::nullopt, nullptr) == SQLITE_OK);
+        CHECK(stmt.Step() == SQLITE_DONE);
+        CHECK(stmt.ResetStmt() == SQLITE_OK);
+        const char *null_text = nullptr;
+        CHECK(stmt.Bind((uint64_t)3, null_text, 0, std::optional<int>(), std::string("moved")) == SQLITE_OK);
+        CHECK(stmt.Step() == SQLITE_DONE);
+        CHECK(stmt.ResetStmt() == SQLITE_OK);
+        // 参数个数超出时返回错误，前面的参数已经绑定
+        CHECK(stmt.Bind(1, 2, 3, 4, 5, 6) == SQLITE_RANGE);
+    }
+
+    SQLite3Stmt stmt = db.GetDBStmt("SELECT i, s, f, o, b FROM r ORDER BY rowid");
+    int row = 0;
+    for (auto [i, s, f, o, b] : stmt.Rows<int64_t, std::string_view, double, std::optional<int>, std::vector<unsigned char>>()) {
+        if (row == 0) {
+            CHECK(i == (int64_t)1 << 40 && s == "text" && f == 1.5 && o == 7);
+            CHECK((b == std::vector<unsigned char>{1, 2}));
+        } else if (row == 1) {
+            CHECK(i == -2 && s == "view" && f == 2.25 && !o && b.empty());
+        } else {
+            CHECK(i == 3 && s.empty() && f == 0 && !o);
+            CHECK((b == std::vector<unsigned char>{'m', 'o', 'v', 'e', 'd'}));
+        }
+        ++row;
+    }
+    CHECK(row == 3);
+    CHECK(stmt.Status() == SQLITE_DONE);
+
+    SQLite3Stmt text_stmt = db.GetDBStmt("SELECT s FROM r ORDER BY rowid");
+    row = 0;
+    for (auto [s] : text_stmt.Rows<std::optional<std::string>>()) {
+        CHECK(s.has_value() == (row != 2));
+        ++row;
+    }
+    CHECK(row == 3);
+
+    // const的右值不能转移，绑定时由SQLite拷贝，原对象不变
+    const std::string const_text("const");
+    const std::vector<unsigned char> const_blob{3, 4};
+    SQLite3Stmt copy_stmt = db.GetDBStmt("SELECT ?, ?, ?");
+    CHECK(copy_stmt.Bind(std::move(const_text), std::move(const_blob), row == 3 ? const_text : std::string("other")) == SQLITE_OK);
+    CHECK(copy_stmt.Step() == SQLITE_ROW);
+    CHECK(copy_stmt.GetColumnTextView(0) == "const");
+    CHECK(copy_stmt.GetColumnBytes(1) == 2);
+    CHECK(copy_stmt.GetColumnTextView(2) == "const");
+    CHECK(const_text == "const" && const_blob.size() == 2);
+
+    // 没有结果的查询一次也不进入循环
+    SQLite3Stmt empty_stmt = db.GetDBStmt("SELECT i FROM r WHERE i > ?");
+    CHECK(empty_stmt.Bind((int64_t)1 << 50) == SQLITE_OK);
+    for (auto [i] : empty_stmt.Rows<int64_t>()) {
+        (void)i;
+        CHECK(false);
+    }
+    CHECK(empty_stmt.Status() == SQLITE_DONE);
+}
+
+// user-019: 在zeroblob分配的空间上分块写入，ReadNext按块顺序读出，越界读写失败，Reopen切换到另一行
+void TestBlobStream() {
+    SQLite3Wrapper db(":memory:");
+    CHECK(db.OpenDB() == SQLITE_OK);
+    const int kBlobSize = 100000;
+    CHECK(db.Execute("CREATE TABLE img(id INTEGER PRIMARY KEY, data BLOB);"
+                     "INSERT INTO img VALUES(1, zeroblob(100000)), (2, x'0102030405')", NULL, NULL, NULL) == SQLITE_OK);
+    std::vector<unsigned char> expected(kBlobSize);
+    for (int i = 0; i < kBlobSize; ++i) {
+        expected[i] = (unsigned char)(i * 31 + 7);
+    }
+
+    {
+        SQLite3BlobStream writer = db.OpenBlob("img", "data", 1, true);
+        CHECK(writer.IsOpen() && writer.Status() == SQLITE_OK);
+        CHECK(writer.Size() == kBlobSize);
+        for (int offset = 0; offset < kBlobSize; offset += 4096) {
+            CHECK(writer.Write(offset, expected.data() + offset, std::min(4096, kBlobSize - offset)) == SQLITE_OK);
+        }
+        // 写入不能改变长度
+        CHECK(writer.Write(kBlobSize - 1, expected.data(), 2) == SQLITE_ERROR);
+        CHECK(writer.Close() == SQLITE_OK);
+        CHECK(!writer.IsOpen());
+    }
+
+    SQLite3BlobStream reader = db.OpenBlob("img", "data", 1, false);
+    CHECK(reader.IsOpen());
+    std::vector<unsigned char> data;
+    unsigned char buffer[3000];
+    int read_size = 0;
+    while (reader.ReadNext(buffer, sizeof(buffer), &read_size) == SQLITE_OK && read_size > 0) {
+        data.insert(data.end(), buffer, buffer + read_size);
+    }
+    CHECK(reader.Status() == SQLITE_OK);
+    CHECK(data == expected);
+    CHECK(reader.GetPosition() == kBlobSize);
+
+    reader.Seek(kBlobSize - 10);
+    CHECK(reader.ReadNext(buffer, sizeof(buffer), &read_size) == SQLITE_OK);
+    CHECK(read_size == 10 && buffer[0] == expected[kBlobSize - 10]);
+    CHECK(reader.Read(kBlobSize - 1, buffer, 2) == SQLITE_ERROR);
+    CHECK(reader.Write(0, buffer, 1) == SQLITE_READONLY);
+
+    // 移动后由新对象持有句柄，切换到第2行从头读
+    SQLite3BlobStream moved(std::move(reader));
+    CHECK(!reader.IsOpen() && moved.IsOpen());
+    CHECK(reader.Read(0, buffer, 1) == SQLITE_MISUSE);
+    CHECK(moved.Reopen(2) == SQLITE_OK);
+    CHECK(moved.Size() == 5 && moved.GetPosition() == 0);
+    CHECK(moved.ReadNext(buffer, sizeof(buffer), &read_size) == SQLITE_OK);
+    CHECK(read_size == 5 && buffer[0] == 1 && buffer[4] == 5);
+    CHECK(moved.Reopen(3) != SQLITE_OK);
+
+    SQLite3BlobStream missing = db.OpenBlob("img", "data", 42, false);
+    CHECK(!missing.IsOpen() && missing.Status() != SQLITE_OK);
+    CHECK(missing.Size() == 0);
+    CHECK(missing.ReadNext(buffer, sizeof(buffer), &read_size) == SQLITE_MISUSE && read_size == 0);
+    moved.Close();
+}
+
+std::string PragmaValue(SQLite3Wrapper &db, const std::string &pragma) {
+    SQLite3Stmt stmt = db.GetDBStmt("PRAGMA " + pragma);
+    CHECK(stmt.Step() == SQLITE_ROW);
+    return stmt.GetColumnText(0);
+}
+
+// user-020: 各个预设打开后PRAGMA的实际值；只读预设不能写入；任何一项失败时连接被关闭
+void TestOpenOptions() {
+    std::string path = TempDbPath("options");
+    {
+        SQLite3Wrapper db(path);
+        CHECK(db.OpenDB(SQLite3OpenOptions::BulkLoad()) == SQLITE_OK);
+        CHECK(PragmaValue(db, "page_size") == "16384");
+        CHECK(PragmaValue(db, "journal_mode") == "memory");
+        CHECK(PragmaValue(db, "synchronous") == "0");
+        CHECK(PragmaValue(db, "locking_mode") == "exclusive");
+        CHECK(PragmaValue(db, "temp_store") == "2");
+        CHECK(PragmaValue(db, "cache_size") == "-262144");
+        CHECK(db.Execute("CREATE TABLE t(v INTEGER); INSERT INTO t VALUES(1)", NULL, NULL, NULL) == SQLITE_OK);
+    }
+    {
+        SQLite3Wrapper db(path);
+        CHECK(db.OpenDB(SQLite3OpenOptions::ReadHeavy()) == SQLITE_OK);
+        CHECK(PragmaValue(db, "journal_mode") == "wal");
+        CHECK(PragmaValue(db, "synchronous") == "1");
+        CHECK(PragmaValue(db, "temp_store") == "2");
+        CHECK(PragmaValue(db, "cache_size") == "-65536");
+        CHECK(PragmaValue(db, "busy_timeout") == "5000");
+        // 编译时限制了mmap大小的SQLite会把值截断到上限
+        CHECK(std::stoll(PragmaValue(db, "mmap_size")) > 0);
+        // page_size在BulkLoad建库时已经确定
+        CHECK(PragmaValue(db, "page_size") == "16384");
+
+        SQLite3Wrapper reader(path);
+        CHECK(reader.OpenDB(SQLite3OpenOptions::ReadHeavy(true)) == SQLITE_OK);
+        CHECK(CountRows(reader, "t") == 1);
+        CHECK(reader.Execute("INSERT INTO t VALUES(2)", NULL, NULL, NULL) == SQLITE_READONLY);
+    }
+    {
+        SQLite3Wrapper db(path);
+        CHECK(db.OpenDB(SQLite3OpenOptions::Durable()) == SQLITE_OK);
+        CHECK(PragmaValue(db, "journal_mode") == "wal");
+        CHECK(PragmaValue(db, "synchronous") == "2");
+        CHECK(PragmaValue(db, "busy_timeout") == "5000");
+        // 没有设置的项保持默认值
+        CHECK(PragmaValue(db, "locking_mode") == "normal");
+    }
+
+    SQLite3Wrapper missing(TempDbPath("options_missing"));
+    CHECK(missing.OpenDB(SQLite3OpenOptions::ReadHeavy(true)) != SQLITE_OK);
+    CHECK(!missing.IsOpen());
+
+    SQLite3OpenOptions bad_options;
+    bad_options.synchronous = "NORMAL; NOT SQL";
+    SQLite3Wrapper bad(path);
+    CHECK(bad.OpenDB(bad_options) == SQLITE_ERROR);
+    CHECK(!bad.IsOpen());
+}
+
+// user-018: 写操作全部提交后后台线程应当阻塞等待，commit_interval为0时也不能空转
+void TestAsyncWriterIdle() {
+    for (auto interval : {std::chrono::milliseconds(0), std::chrono::milliseconds(5)}) {
+        SQLite3Wrapper db(":memory:");
+        CHECK(db.OpenDB() == SQLITE_OK);
+        CHECK(db.Execute("CREATE TABLE w(v INTEGER)", NULL, NULL, NULL) == SQLITE_OK);
+
+        SQLite3AsyncWriter writer(db);
+        writer.SetCommitPolicy(100, interval);
+        CHECK(writer.Start());
+        std::vector<std::future<int>> futures;
+        for (int i = 0; i < 10; ++i) {
+            futures.push_back(writer.Post([i](SQLite3Wrapper &conn) {
+                return conn.Execute("INSERT INTO w VALUES(" + std::to_string(i) + ")", NULL, NULL, NULL);
+            }));
+        }
+        // 不调用Flush，写操作也要在commit_interval之后提交
+        for (auto &future : futures) {
+            CHECK(future.get() == SQLITE_OK);
+        }
+
+        double cpu_start = CpuMs();
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        double idle_cpu_ms = CpuMs() - cpu_start;
+        fprintf(stderr, "interval %lld ms, idle writer cpu %.1f ms / 300 ms\n", (long long)interval.count(), idle_cpu_ms);
+        CHECK(idle_cpu_ms < 15);
+
+        CHECK(writer.Flush().get() == SQLITE_OK);
+        writer.Stop();
+        CHECK(CountRows(db, "w") == 10);
+    }
+}
+
+// user-018: commit_interval为0时积压的写操作按ops_per_commit合并提交，不是每取出一批(kMaxOpsPerPop个)就提交一次
+void TestAsyncWriterBacklogCommit() {
+    const int kOpNum = 3000;
+    SQLite3Wrapper db(":memory:");
+    CHECK(db.OpenDB() == SQLITE_OK);
+    CHECK(db.Execute("CREATE TABLE w(v INTEGER)", NULL, NULL, NULL) == SQLITE_OK);
+    CHECK(db.EnableProfile() == SQLITE_OK);
+
+    SQLite3AsyncWriter writer(db);
+    writer.SetCommitPolicy(100000, std::chrono::milliseconds(0));
+    CHECK(writer.Start());
+    // 第一个写操作占住后台线程，其余的写操作在队列中积压
+    std::future<int> first = writer.Post([](SQLite3Wrapper &conn) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        return conn.Execute("INSERT INTO w VALUES(-1)", NULL, NULL, NULL);
+    });
+    std::vector<std::future<int>> futures;
+    for (int i = 0; i < kOpNum; ++i) {
+        futures.push_back(writer.Post([i](SQLite3Wrapper &conn) {
+            SQLite3StmtLease stmt = conn.GetCachedStmt("INSERT INTO w VALUES(?)");
+            stmt->Bind(i);
+            return stmt->Step();
+        }));
+    }
+    CHECK(first.get() == SQLITE_OK);
+    for (auto &future : futures) {
+        CHECK(future.get() == SQLITE_OK);
+    }
+    writer.Stop();
+    CHECK(kOpNum > 2 * (int)SQLite3AsyncWriter::kMaxOpsPerPop);
+
+    int commit_num = 0;
+    for (const auto &item : db.GetProfileJson()) {
+        if (item["sql"] == "COMMIT") {
+            commit_num = item["calls"];
+        }
+    }
+    // 3001个操作至少要取3批；第一个操作单独被取出时它所在的一批提交一次，积压的几批合并提交一次，
+    // 第一次取出时其它操作已经入队则全部合并为一次提交；每批都提交时至少3次
+    fprintf(stderr, "%d ops, %d commits\n", kOpNum + 1, commit_num);
+    CHECK(commit_num >= 1 && commit_num <= 2);
+    db.DisableProfile();
+    CHECK(CountRows(db, "w") == kOpNum + 1);
+}
+
+// user-021: 每次执行的行数记在语句自己的记录中，同一类SQL合并统计，Reset之后重新计数
+void TestProfileRows() {
+    SQLite3Wrapper db(":memory:");
+    CHECK(db.OpenDB() == SQLITE_OK);
+    CHECK(db.Execute("CREATE TABLE p(v INTEGER)", NULL, NULL, NULL) == SQLITE_OK);
+    for (int i = 0; i < 100; ++i) {
+        CHECK(db.Execute("INSERT INTO p VALUES(" + std::to_string(i) + ")", NULL, NULL, NULL) == SQLITE_OK);
+    }
+    CHECK(db.EnableProfile() == SQLITE_OK);
+
+    auto run_queries = [&db] {
+        SQLite3Stmt stmt = db.GetDBStmt("SELECT v FROM p WHERE v < ?");
+        for (int limit : {10, 20, 30}) {
+            CHECK(stmt.Bind(limit) == SQLITE_OK);
+            while (stmt.Step() == SQLITE_ROW) {
+            }
+            CHECK(stmt.ResetStmt() == SQLITE_OK);
+        }
+        // 另一个语句交替执行，last_stmt_缓存失效后仍要计到正确的语句上
+        SQLite3Stmt a = db.GetDBStmt("SELECT v FROM p WHERE v >= 95");
+        SQLite3Stmt b = db.GetDBStmt("SELECT v FROM p WHERE v < 5");
+        for (int i = 0; i < 5; ++i) {
+            CHECK(a.Step() == SQLITE_ROW);
+            CHECK(b.Step() == SQLITE_ROW);
+        }
+        CHECK(a.Step() == SQLITE_DONE);
+        CHECK(b.Step() == SQLITE_DONE);
+    };
+    auto find_stat = [&db](const std::string &sql) {
+        util::json::json result = db.GetProfileJson();
+        for (const auto &item : result) {
+            if (item["sql"] == sql) {
+                return item;
+            }
+        }
+        return util::json::json();
+    };
+
+    run_queries();
+    util::json::json stat = find_stat("SELECT v FROM p WHERE v < ?");
+    CHECK(!stat.is_null());
+    CHECK(stat["calls"] == 4);
+    CHECK(stat["rows"] == 10 + 20 + 30 + 5);
+    stat = find_stat("SELECT v FROM p WHERE v >= ?");
+    CHECK(!stat.is_null());
+    CHECK(stat["calls"] == 1);
+    CHECK(stat["rows"] == 5);
+
+    db.ResetProfile();
+    CHECK(db.GetProfileJson().empty());
+    run_queries();
+    stat = find_stat("SELECT v FROM p WHERE v < ?");
+    CHECK(stat["calls"] == 4);
+    CHECK(stat["rows"] == 65);
+    db.DisableProfile();
+}
+
+// user-021: 拼接字面量的原始SQL超过缓存上限时缓存被清空重建，归一化后的统计不受影响，已在执行中的语句仍记到原来的统计项上
+void TestProfileRawSqlCap() {
+    SQLite3Wrapper db(":memory:");
+    CHECK(db.OpenDB() == SQLITE_OK);
+    CHECK(db.Execute("CREATE TABLE p(v INTEGER)", NULL, NULL, NULL) == SQLITE_OK);
+    CHECK(db.EnableProfile() == SQLITE_OK);
+
+    SQLite3Stmt stmt = db.GetDBStmt("SELECT count(*) FROM p");
+    CHECK(stmt.Step() == SQLITE_ROW);
+    CHECK(stmt.ResetStmt() == SQLITE_OK);
+    const int kSqlNum = (int)SQLite3Profiler::kMaxRawSqlNum * 2 + 10;
+    for (int i = 0; i < kSqlNum; ++i) {
+        CHECK(db.Execute("INSERT INTO p VALUES(" + std::to_string(i) + ")", NULL, NULL, NULL) == SQLITE_OK);
+    }
+    CHECK(stmt.Step() == SQLITE_ROW);
+    CHECK(stmt.GetColumnInt(0) == kSqlNum);
+    CHECK(stmt.ResetStmt() == SQLITE_OK);
+
+    int insert_calls = 0;
+    int count_calls = 0;
+    for (const auto &item : db.GetProfileJson()) {
+        if (item["sql"] == "INSERT INTO p VALUES(?)") {
+            insert_calls = item["calls"];
+        } else if (item["sql"] == "SELECT count(*) FROM p") {
+            count_calls = item["calls"];
+        }
+    }
+    CHECK(insert_calls == kSqlNum);
+    CHECK(count_calls == 2);
+    db.DisableProfile();
+}
+
+// user-022: 源库一直被其它连接锁住时Snapshot退避重试，超过busy_timeout返回SQLITE_BUSY，不空转
+void TestSnapshotBusyBackoff() {
+    std::string path = TempDbPath("busy");
+    std::string dest_path = TempDbPath("busy_dest");
+    SQLite3Wrapper db(path);
+    CHECK(db.OpenDB() == SQLITE_OK);
+    CHECK(db.Execute("CREATE TABLE t(v INTEGER); INSERT INTO t VALUES(1)", NULL, NULL, NULL) == SQLITE_OK);
+
+    SQLite3Wrapper locker(path);
+    CHECK(locker.OpenDB() == SQLITE_OK);
+    CHECK(locker.Execute("BEGIN EXCLUSIVE", NULL, NULL, NULL) == SQLITE_OK);
+
+    auto start = std::chrono::steady_clock::now();
+    double cpu_start = CpuMs();
+    int ret = db.Snapshot(dest_path, 16, nullptr, std::chrono::milliseconds(0), std::chrono::milliseconds(300));
+    double cpu_ms = CpuMs() - cpu_start;
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    fprintf(stderr, "busy snapshot ret %d, %lld ms, cpu %.1f ms\n", ret, (long long)elapsed.count(), cpu_ms);
+    CHECK(ret == SQLITE_BUSY);
+    CHECK(elapsed >= std::chrono::milliseconds(300));
+    CHECK(elapsed < std::chrono::milliseconds(2000));
+    CHECK(cpu_ms < 50);
+
+    CHECK(locker.Commit() == SQLITE_OK);
+    CHECK(db.Snapshot(dest_path) == SQLITE_OK);
+}
+
+// user-022: WAL模式下Snapshot开启的读事务在返回前结束，备份失败时也一样；调用方自己开启的事务保持不动
+void TestSnapshotLeavesAutocommit() {
+    std::string path = TempDbPath("pin");
+    std::string dest_path = TempDbPath("pin_dest");
+    SQLite3Wrapper db(path);
+    CHECK(db.OpenDB() == SQLITE_OK);
+    CHECK(db.Execute("PRAGMA journal_mode=WAL; CREATE TABLE t(v INTEGER); INSERT INTO t VALUES(1)", NULL, NULL, NULL) == SQLITE_OK);
+
+    // 连接仍在事务中时BEGIN会失败
+    CHECK(db.Snapshot(dest_path) == SQLITE_OK);
+    CHECK(db.Begin() == SQLITE_OK);
+    CHECK(db.Commit() == SQLITE_OK);
+
+    // 目标路径所在目录不存在，打开目标库失败
+    CHECK(db.Snapshot("sqlite3_wrapper_test_no_such_dir/dest.db") != SQLITE_OK);
+    CHECK(db.Begin() == SQLITE_OK);
+    CHECK(db.Commit() == SQLITE_OK);
+
+    CHECK(db.Begin() == SQLITE_OK);
+    CHECK(CountRows(db, "t") == 1);
+    CHECK(db.Snapshot(dest_path) == SQLITE_OK);
+    CHECK(db.Commit() == SQLITE_OK);
+    SQLite3Wrapper dest(dest_path);
+    CHECK(dest.OpenDB() == SQLITE_OK);
+    CHECK(CountRows(dest, "t") == 1);
+}
+
+// user-022: WAL模式下备份期间写连接不被阻塞，备份内容是开始时刻的一致快照
+void TestSnapshotWriterLatency() {
+    std::string path = TempDbPath("wal");
+    std::string dest_path = TempDbPath("wal_dest");
+    const int kRowNum = 20000;
+    {
+        SQLite3Wrapper db(path);
+        CHECK(db.OpenDB() == SQLITE_OK);
+        CHECK(db.Execute("PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL; CREATE TABLE t(v INTEGER, data BLOB)", NULL, NULL, NULL) == SQLITE_OK);
+        CHECK(db.Begin() == SQLITE_OK);
+        SQLite3Stmt stmt = db.GetDBStmt("INSERT INTO t VALUES(?, randomblob(256))");
+        for (int i = 0; i < kRowNum; ++i) {
+            CHECK(stmt.Bind(i) == SQLITE_OK);
+            CHECK(stmt.Step() == SQLITE_DONE);
+            CHECK(stmt.ResetStmt() == SQLITE_OK);
+        }
+        CHECK(db.Commit() == SQLITE_OK);
+    }
+
+    SQLite3Wrapper writer(path);
+    CHECK(writer.OpenDB() == SQLITE_OK);
+    CHECK(writer.SetBusyTimeout(5000) == SQLITE_OK);
+    CHECK(writer.Execute("PRAGMA synchronous=NORMAL", NULL, NULL, NULL) == SQLITE_OK);
+    std::atomic<bool> is_stop{false};
+    std::atomic<bool> is_snapshot{false};
+    std::atomic<int> write_num[2] = {{0}, {0}};
+    std::atomic<int64_t> max_latency_us[2] = {{0}, {0}};
+    std::atomic<int> error_num{0};
+    std::thread write_thread([&] {
+        SQLite3Stmt stmt = writer.GetDBStmt("INSERT INTO t VALUES(-1, randomblob(256))");
+        while (!is_stop.load()) {
+            int phase = is_snapshot.load() ? 1 : 0;
+            auto start = std::chrono::steady_clock::now();
+            int ret = stmt.Step();
+            stmt.ResetStmt();
+            int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+            if (ret != SQLITE_DONE) {
+                ++error_num;
+            }
+            ++write_num[phase];
+            if (us > max_latency_us[phase].load()) {
+                max_latency_us[phase].store(us);
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    SQLite3Wrapper reader(path);
+    CHECK(reader.OpenDB() == SQLITE_OK);
+    is_snapshot.store(true);
+    auto start = std::chrono::steady_clock::now();
+    int snapshot_ret = reader.Snapshot(dest_path, 16);
+    double snapshot_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    is_snapshot.store(false);
+    is_stop.store(true);
+    write_thread.join();
+
+    double base_rate = write_num[0].load() / 300.0;
+    double snapshot_rate = write_num[1].load() / snapshot_ms;
+    fprintf(stderr, "writes/ms before %.2f during %.2f (%.0f ms snapshot), max latency us before %lld during %lld\n",
+            base_rate, snapshot_rate, snapshot_ms, (long long)max_latency_us[0].load(), (long long)max_latency_us[1].load());
+    CHECK(snapshot_ret == SQLITE_OK);
+    CHECK(error_num.load() == 0);
+    CHECK(write_num[1].load() > 0);
+    CHECK(snapshot_rate >= base_rate * 0.25);
+    CHECK(max_latency_us[1].load() < 200 * 1000);
+
+    // 快照包含全部初始数据，并且是某一时刻的一致状态
+    SQLite3Wrapper dest(dest_path);
+    CHECK(dest.OpenDB() == SQLITE_OK);
+    SQLite3Stmt check_stmt = dest.GetDBStmt("PRAGMA integrity_check");
+    CHECK(check_stmt.Step() == SQLITE_ROW);
+    CHECK(check_stmt.GetColumnTextView(0) == "ok");
+    CHECK(CountRows(dest, "t WHERE v >= 0") == kRowNum);
+    CHECK(CountRows(dest, "t") <= CountRows(writer, "t"));
+}
+
+}  // namespace
+
+int main() {
+    RUN_TEST(TestFetchBatch);
+    RUN_TEST(TestFetchBatchNoMem);
+    RUN_TEST(TestConnStateStress);
+    RUN_TEST(TestFinalizeWithoutConnState);
+    RUN_TEST(TestPoolLease);
+    RUN_TEST(TestStmtCacheHitMiss);
+    RUN_TEST(TestStmtCacheEviction);
+    RUN_TEST(TestBulkWriterFlush);
+    RUN_TEST(TestColumnViews);
+    RUN_TEST(TestMoveInBinds);
+    RUN_TEST(TestTypedRowsAndBind);
+    RUN_TEST(TestBlobStream);
+    RUN_TEST(TestOpenOptions);
+    RUN_TEST(TestAsyncWriterIdle);
+    RUN_TEST(TestAsyncWriterBacklogCommit);
+    RUN_TEST(TestProfileRows);
+    RUN_TEST(TestProfileRawSqlCap);
+    RUN_TEST(TestSnapshotBusyBackoff);
+    RUN_TEST(TestSnapshotLeavesAutocommit);
+    RUN_TEST(TestSnapshotWriterLatency);
+    return 0;
+}
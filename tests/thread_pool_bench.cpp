@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "util/ThreadPoolUtil.h"
+#include "BenchUtil.h"
+
+using util::ThreadPool;
+
+namespace {
+
+const char *ModeName(ThreadPool::SchedulerMode mode) {
+    return mode == ThreadPool::SchedulerMode::kWorkStealing ? "stealing" : "global";
+}
+
+void WaitCount(const std::atomic<long long> &count, long long target) {
+    while (count.load() < target) {
+        std::this_thread::yield();
+    }
+}
+
+// user-002: 空任务的提交吞吐，submit为提交线程全部提交完所用的时间，total包括任务全部执行完
+void BenchSubmitThroughput(double scale) {
+    const long long kTaskNum = Scaled(2000000, scale);
+    for (auto mode : {ThreadPool::SchedulerMode::kGlobalQueue, ThreadPool::SchedulerMode::kWorkStealing}) {
+        for (int submitter_num : {1, 4}) {
+            for (const char *api : {"Post", "Submit", "Run"}) {
+                ThreadPool::ThreadPoolConfig config{4, 4, 0, std::chrono::seconds(5)};
+                config.scheduler_mode = mode;
+                ThreadPool pool(config);
+                pool.Start();
+                std::atomic<long long> count{0};
+                long long per_thread = kTaskNum / submitter_num;
+                auto start = std::chrono::steady_clock::now();
+                std::vector<std::thread> submitters;
+                for (int t = 0; t < submitter_num; ++t) {
+                    submitters.emplace_back([&pool, &count, api, per_thread] {
+                        for (long long i = 0; i < per_thread; ++i) {
+                            if (api[0] == 'P') {
+                                pool.Post([&count] { ++count; });
+                            } else if (api[0] == 'S') {
+                                pool.Submit([&count] { ++count; });
+                            } else {
+                                pool.Run([&count] { ++count; });
+                            }
+                        }
+                    });
+                }
+                for (auto &submitter : submitters) {
+                    submitter.join();
+                }
+                double submit_ms = ElapsedMs(start);
+                WaitCount(count, per_thread * submitter_num);
+                double total_ms = ElapsedMs(start);
+                long long n = per_thread * submitter_num;
+                printf("%-8s %-6s submitters=%d tasks=%lld submit %.2f M/s, total %.2f M/s\n",
+                       ModeName(mode), api, submitter_num, n, n / submit_ms / 1000, n / total_ms / 1000);
+            }
+        }
+    }
+}
+
+// 模拟一个很小的任务，约1微秒
+void SpinFor(std::chrono::nanoseconds duration) {
+    auto end = std::chrono::steady_clock::now() + duration;
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+const char *PolicyName(int max_task_size, ThreadPool::OverflowPolicy policy) {
+    if (max_task_size <= 0) {
+        return "unbounded";
+    }
+    switch (policy) {
+        case ThreadPool::OverflowPolicy::kBlock:
+            return "kBlock";
+        case ThreadPool::OverflowPolicy::kReject:
+            return "kReject";
+        default:
+            return "kCallerRuns";
+    }
+}
+
+// user-004: 提交速度远大于执行速度时各溢出策略下的排队峰值和吞吐
+void BenchOverflowPolicy(double scale) {
+    const long long kTaskNum = Scaled(500000, scale);
+    struct Case {
+        int max_task_size;
+        ThreadPool::OverflowPolicy policy;
+    };
+    for (Case c : {Case{0, ThreadPool::OverflowPolicy::kBlock}, Case{1024, ThreadPool::OverflowPolicy::kBlock},
+                   Case{1024, ThreadPool::OverflowPolicy::kCallerRuns}, Case{1024, ThreadPool::OverflowPolicy::kReject}}) {
+        ThreadPool::ThreadPoolConfig config{4, 4, c.max_task_size, std::chrono::seconds(5)};
+        config.overflow_policy = c.policy;
+        ThreadPool pool(config);
+        pool.Start();
+        std::atomic<long long> count{0};
+        long long accepted = 0;
+        int peak_queued = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (long long i = 0; i < kTaskNum; ++i) {
+            if (pool.Post([&count] {
+                SpinFor(std::chrono::nanoseconds(1000));
+                ++count;
+            })) {
+                ++accepted;
+            }
+            if ((i & 255) == 0) {
+                peak_queued = std::max(peak_queued, pool.GetQueuedTaskSize());
+            }
+        }
+        WaitCount(count, accepted);
+        double total_ms = ElapsedMs(start);
+        printf("%-11s tasks=%lld done %.2f M/s, peak queued %d (%.1f KB of tasks), blocked %d, caller runs %d, rejected %d\n",
+               PolicyName(c.max_task_size, c.policy), kTaskNum, accepted / total_ms / 1000, peak_queued,
+               peak_queued * sizeof(ThreadPool::QueuedTask) / 1024.0, pool.GetBlockedTaskNum(),
+               pool.GetCallerRunTaskNum(), pool.GetRejectedTaskNum());
+    }
+}
+
+// 返回已排序样本的p分位值
+double Percentile(std::vector<double> &samples, double p) {
+    if (samples.empty()) {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    std::size_t index = std::min(samples.size() - 1, static_cast<std::size_t>(p * samples.size()));
+    return samples[index];
+}
+
+// user-007: 线程池被大量积压任务占满时交互任务的等待时间
+// before: 积压任务和交互任务都以kNormal提交，同一个先进先出队列，相当于没有优先级时的情况
+// after: 积压任务以kBackground、交互任务以kHigh提交，另外给出kHigh的等待时间直方图
+void BenchHighLaneLatency(double scale) {
+    using Priority = ThreadPool::TaskPriority;
+    const long long kBacklogNum = Scaled(200000, scale);
+    const int kInteractiveNum = 200;
+    for (bool is_priority : {false, true}) {
+        Priority backlog_lane = is_priority ? Priority::kBackground : Priority::kNormal;
+        Priority interactive_lane = is_priority ? Priority::kHigh : Priority::kNormal;
+        ThreadPool::ThreadPoolConfig config{4, 4, 0, std::chrono::seconds(5)};
+        config.is_record_wait_time = true;
+        ThreadPool pool(config);
+        pool.Start();
+        std::atomic<long long> count{0};
+        for (long long i = 0; i < kBacklogNum; ++i) {
+            pool.Post(backlog_lane, [&count] {
+                SpinFor(std::chrono::microseconds(20));
+                ++count;
+            });
+        }
+
+        std::mutex wait_mutex;
+        std::vector<double> wait_us;
+        for (int i = 0; i < kInteractiveNum && count.load() < kBacklogNum; ++i) {
+            auto enqueue_time = std::chrono::steady_clock::now();
+            pool.Post(interactive_lane, [enqueue_time, &wait_mutex, &wait_us] {
+                double us = ElapsedMs(enqueue_time) * 1000;
+                std::lock_guard<std::mutex> lock(wait_mutex);
+                wait_us.push_back(us);
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        pool.ShutDown();
+        printf("%-22s backlog=%lld interactive=%zu wait p50 %.0f us, p99 %.0f us",
+               is_priority ? "kHigh over kBackground" : "kNormal FIFO", kBacklogNum, wait_us.size(),
+               Percentile(wait_us, 0.5), Percentile(wait_us, 0.99));
+        if (is_priority) {
+            ThreadPool::WaitTimeHistogram histogram = pool.GetWaitTimeHistogram(Priority::kHigh);
+            printf(", histogram p99 <= %llu us", (unsigned long long)histogram.Percentile(0.99));
+        }
+        printf("\n");
+    }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    double scale = BenchScale(argc, argv);
+    RUN_BENCH(BenchSubmitThroughput, scale);
+    RUN_BENCH(BenchOverflowPolicy, scale);
+    RUN_BENCH(BenchHighLaneLatency, scale);
+    return 0;
+}
@@ -0,0 +1,583 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "util/ThreadPoolUtil.h"
+#include "TestUtil.h"
+
+using util::ThreadPool;
+using util::TaskGraph;
+
+// 统计测试区间内的堆分配次数
+static std::atomic<bool> g_is_count_alloc{false};
+static std::atomic<int64_t> g_alloc_num{0};
+
+void *operator new(std::size_t size) {
+    if (g_is_count_alloc.load(std::memory_order_relaxed)) {
+        g_alloc_num.fetch_add(1, std::memory_order_relaxed);
+    }
+    void *p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+// 与上面的operator new配对，GCC不认识这种替换方式，关掉误报
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+#pragma GCC diagnostic pop
+
+namespace {
+
+ThreadPool::ThreadPoolConfig MakeConfig(int threads, ThreadPool::SchedulerMode mode = ThreadPool::SchedulerMode::kGlobalQueue) {
+    ThreadPool::ThreadPoolConfig config{threads, threads, 1024, std::chrono::seconds(5)};
+    config.scheduler_mode = mode;
+    return config;
+}
+
+void TestPostAndSubmit() {
+    for (auto mode : {ThreadPool::SchedulerMode::kGlobalQueue, ThreadPool::SchedulerMode::kWorkStealing}) {
+        ThreadPool pool(MakeConfig(4, mode));
+        CHECK(pool.Start());
+        std::atomic<int> count{0};
+        std::vector<util::TaskFuture<int>> futures;
+        for (int i = 0; i < 1000; ++i) {
+            CHECK(pool.Post([&count] { ++count; }));
+            futures.push_back(pool.Submit([i] { return i * 2; }));
+        }
+        for (int i = 0; i < 1000; ++i) {
+            CHECK(futures[i].Get() == i * 2);
+        }
+        pool.ShutDown();
+        CHECK(count.load() == 1000);
+    }
+}
+
+void TestSubmitException() {
+    ThreadPool pool(MakeConfig(2));
+    CHECK(pool.Start());
+    auto future = pool.Submit([]() -> int { throw std::runtime_error("task"); });
+    bool is_thrown = false;
+    try {
+        future.Get();
+    } catch (const std::runtime_error &) {
+        is_thrown = true;
+    }
+    CHECK(is_thrown);
+}
+
+// 让线程池的全部线程阻塞在任务中，直到release被设置
+void BlockAllThreads(ThreadPool &pool, int thread_num, std::shared_future<void> released) {
+    std::atomic<int> running{0};
+    for (int i = 0; i < thread_num; ++i) {
+        CHECK(pool.Post([released, &running] {
+            ++running;
+            released.wait();
+        }));
+    }
+    while (running.load() != thread_num) {
+        std::this_thread::yield();
+    }
+}
+
+// user-001: kWorkStealing模式下外部提交的任务大致按提交顺序开始执行，不能后提交的先执行
+void TestWorkStealingExternalFifo() {
+    const int kThreadNum = 4;
+    const int kTaskNum = 250;
+    ThreadPool pool(MakeConfig(kThreadNum, ThreadPool::SchedulerMode::kWorkStealing));
+    CHECK(pool.Start());
+    std::promise<void> release;
+    BlockAllThreads(pool, kThreadNum, release.get_future().share());
+
+    std::mutex order_mutex;
+    std::vector<int> order;
+    for (int i = 0; i < kTaskNum; ++i) {
+        CHECK(pool.Post([i, &order_mutex, &order] {
+            std::lock_guard<std::mutex> lock(order_mutex);
+            order.push_back(i);
+        }));
+    }
+    release.set_value();
+    pool.ShutDown();
+
+    CHECK(order.size() == kTaskNum);
+    // 各线程取到任务和记录顺序之间可能被别的线程插队，只要求绝大多数任务的位置与提交顺序相差不超过线程数
+    int in_place_num = 0;
+    for (int pos = 0; pos < kTaskNum; ++pos) {
+        if (std::abs(order[pos] - pos) <= kThreadNum) {
+            ++in_place_num;
+        }
+    }
+    fprintf(stderr, "first started %d, %d/%d tasks near their FIFO position\n", order[0], in_place_num, kTaskNum);
+    CHECK(in_place_num >= kTaskNum * 9 / 10);
+}
+
+// 等待cond成立，超过timeout返回false
+template<typename F>
+bool WaitUntil(F &&cond, std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!cond()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// user-002: 任务多于空闲线程时增加Cache线程直到max_threads，空闲time_out之后回收到core_threads
+void TestElasticThreads() {
+    for (auto mode : {ThreadPool::SchedulerMode::kGlobalQueue, ThreadPool::SchedulerMode::kWorkStealing}) {
+        ThreadPool::ThreadPoolConfig config{2, 6, 0, std::chrono::seconds(1)};
+        config.scheduler_mode = mode;
+        ThreadPool pool(config);
+        CHECK(pool.Start());
+        CHECK(WaitUntil([&pool] { return pool.GetWaitingThreadSize() == 2; }, std::chrono::seconds(5)));
+        CHECK(pool.GetTotalThreadSize() == 2);
+
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        std::atomic<int> running{0};
+        for (int i = 0; i < 10; ++i) {
+            CHECK(pool.Post([released, &running] {
+                ++running;
+                released.wait();
+            }));
+        }
+        CHECK(WaitUntil([&running] { return running.load() == 6; }, std::chrono::seconds(5)));
+        CHECK(pool.GetTotalThreadSize() == 6);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK(running.load() == 6);
+        CHECK(pool.GetTotalThreadSize() == 6);
+
+        auto release_time = std::chrono::steady_clock::now();
+        release.set_value();
+        CHECK(WaitUntil([&running] { return running.load() == 10; }, std::chrono::seconds(5)));
+        CHECK(WaitUntil([&pool] { return pool.GetTotalThreadSize() == 2; }, std::chrono::seconds(5)));
+        auto shrink_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - release_time);
+        CHECK(shrink_ms >= std::chrono::milliseconds(900));
+        // 核心线程不会被回收
+        std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+        CHECK(pool.GetTotalThreadSize() == 2);
+
+        std::atomic<int> count{0};
+        for (int i = 0; i < 100; ++i) {
+            CHECK(pool.Post([&count] { ++count; }));
+        }
+        CHECK(WaitUntil([&count] { return count.load() == 100; }, std::chrono::seconds(5)));
+    }
+}
+
+// 单线程、队列容量为2的线程池，唯一的线程阻塞在任务中并且队列已满，release之后才开始取任务
+struct FullPool {
+    explicit FullPool(ThreadPool::OverflowPolicy policy) {
+        ThreadPool::ThreadPoolConfig config{1, 1, 2, std::chrono::seconds(5)};
+        config.overflow_policy = policy;
+        CHECK(pool.Init(config));
+        CHECK(pool.Start());
+        BlockAllThreads(pool, 1, release.get_future().share());
+        for (int i = 0; i < 2; ++i) {
+            CHECK(pool.Post([this] { ++queued_run_num; }));
+        }
+        CHECK(pool.GetQueuedTaskSize() == 2);
+    }
+
+    ~FullPool() {
+        Release();
+        pool.ShutDown();
+    }
+
+    void Release() {
+        if (!is_released) {
+            is_released = true;
+            release.set_value();
+        }
+    }
+
+    // 队列中的任务全部执行完之后所有计数回到初始状态
+    void CheckDrained() {
+        CHECK(WaitUntil([this] { return queued_run_num.load() == 2; }, std::chrono::seconds(5)));
+        CHECK(WaitUntil([this] { return pool.GetWaitingThreadSize() == 1; }, std::chrono::seconds(5)));
+        CHECK(pool.GetQueuedTaskSize() == 0);
+        CHECK(pool.GetTotalThreadSize() == 1);
+    }
+
+    ThreadPool pool;
+    std::promise<void> release;
+    bool is_released = false;
+    std::atomic<int> queued_run_num{0};
+};
+
+// user-004: kBlock阻塞提交线程直到有任务出队
+void TestOverflowBlock() {
+    FullPool full(ThreadPool::OverflowPolicy::kBlock);
+    std::atomic<bool> is_posted{false};
+    std::atomic<bool> is_run{false};
+    std::thread submitter([&] {
+        CHECK(full.pool.Post([&is_run] { is_run = true; }));
+        is_posted = true;
+    });
+    CHECK(WaitUntil([&full] { return full.pool.GetBlockedTaskNum() == 1; }, std::chrono::seconds(5)));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(!is_posted.load());
+    CHECK(full.pool.GetQueuedTaskSize() == 2);
+
+    full.Release();
+    submitter.join();
+    CHECK(is_posted.load());
+    CHECK(WaitUntil([&is_run] { return is_run.load(); }, std::chrono::seconds(5)));
+    full.CheckDrained();
+    CHECK(full.pool.GetBlockedTaskNum() == 1);
+    CHECK(full.pool.GetRejectedTaskNum() == 0);
+    CHECK(full.pool.GetCallerRunTaskNum() == 0);
+}
+
+// user-004: kBlock时线程池自己的线程提交任务不能阻塞等待自己，改为直接执行
+void TestOverflowBlockFromWorker() {
+    ThreadPool::ThreadPoolConfig config{1, 1, 1, std::chrono::seconds(5)};
+    ThreadPool pool(config);
+    CHECK(pool.Start());
+    std::thread::id outer_id;
+    std::thread::id inner_id;
+    auto future = pool.Submit([&] {
+        outer_id = std::this_thread::get_id();
+        // 队列容量为1，第一个任务占满队列后第二个只能在当前线程执行
+        CHECK(pool.Post([] {}));
+        CHECK(pool.Post([&inner_id] { inner_id = std::this_thread::get_id(); }));
+    });
+    CHECK(future.WaitFor(std::chrono::seconds(5)));
+    future.Get();
+    CHECK(inner_id == outer_id);
+    CHECK(pool.GetCallerRunTaskNum() == 1);
+    CHECK(pool.GetBlockedTaskNum() == 0);
+}
+
+// user-004: kCallerRuns在提交线程中直接执行，返回时任务已经执行完
+void TestOverflowCallerRuns() {
+    FullPool full(ThreadPool::OverflowPolicy::kCallerRuns);
+    std::thread::id run_id;
+    CHECK(full.pool.Post([&run_id] { run_id = std::this_thread::get_id(); }));
+    CHECK(run_id == std::this_thread::get_id());
+    auto future = full.pool.Submit([] { return std::this_thread::get_id(); });
+    CHECK(future.IsReady());
+    CHECK(future.Get() == std::this_thread::get_id());
+    auto run_future = full.pool.Run([] { return 7; });
+    CHECK(run_future && run_future->get() == 7);
+    CHECK(full.pool.GetCallerRunTaskNum() == 3);
+    CHECK(full.pool.GetQueuedTaskSize() == 2);
+
+    full.Release();
+    full.CheckDrained();
+    CHECK(full.pool.GetBlockedTaskNum() == 0);
+    CHECK(full.pool.GetRejectedTaskNum() == 0);
+}
+
+// user-004: kReject直接拒绝，Run返回nullptr、Post返回false，队列中的任务不受影响
+void TestOverflowReject() {
+    FullPool full(ThreadPool::OverflowPolicy::kReject);
+    CHECK(!full.pool.Post([] {}));
+    CHECK(full.pool.Run([] { return 1; }) == nullptr);
+    CHECK(!full.pool.Submit([] { return 1; }).Valid());
+    CHECK(full.pool.GetRejectedTaskNum() == 3);
+    CHECK(full.pool.GetQueuedTaskSize() == 2);
+
+    full.Release();
+    full.CheckDrained();
+    CHECK(full.pool.Post([] {}));
+    CHECK(full.pool.GetRejectedTaskNum() == 3);
+}
+
+// 单线程的线程池阻塞时按tasks的顺序提交，释放后返回各任务的执行顺序
+std::vector<int> RunOrder(ThreadPool::ThreadPoolConfig config, const std::vector<ThreadPool::TaskPriority> &tasks) {
+    ThreadPool pool(config);
+    CHECK(pool.Start());
+    std::promise<void> release;
+    BlockAllThreads(pool, 1, release.get_future().share());
+    std::mutex order_mutex;
+    std::vector<int> order;
+    for (int i = 0; i < (int)tasks.size(); ++i) {
+        CHECK(pool.Post(tasks[i], [i, &order_mutex, &order] {
+            std::lock_guard<std::mutex> lock(order_mutex);
+            order.push_back(i);
+        }));
+    }
+    release.set_value();
+    pool.ShutDown();
+    CHECK(order.size() == tasks.size());
+    return order;
+}
+
+// user-007: starvation_limit<=0时严格按kHigh、kNormal、kBackground的顺序执行，同一优先级先进先出
+void TestPriorityOrder() {
+    using Priority = ThreadPool::TaskPriority;
+    for (auto mode : {ThreadPool::SchedulerMode::kGlobalQueue, ThreadPool::SchedulerMode::kWorkStealing}) {
+        ThreadPool::ThreadPoolConfig config = MakeConfig(1, mode);
+        config.starvation_limit = 0;
+        std::vector<Priority> tasks;
+        for (int i = 0; i < 10; ++i) {
+            tasks.push_back(Priority::kBackground);
+            tasks.push_back(Priority::kNormal);
+            tasks.push_back(Priority::kHigh);
+        }
+        std::vector<int> order = RunOrder(config, tasks);
+        for (int pos = 0; pos < 30; ++pos) {
+            Priority expected = pos < 10 ? Priority::kHigh : (pos < 20 ? Priority::kNormal : Priority::kBackground);
+            CHECK(tasks[order[pos]] == expected);
+            if (pos % 10 != 0) {
+                CHECK(order[pos] > order[pos - 1]);
+            }
+        }
+    }
+}
+
+// user-007: 一直有kHigh任务时，kBackground任务在starvation_limit次取任务之内也能执行
+void TestPriorityStarvationLimit() {
+    using Priority = ThreadPool::TaskPriority;
+    for (auto mode : {ThreadPool::SchedulerMode::kGlobalQueue, ThreadPool::SchedulerMode::kWorkStealing}) {
+        std::vector<Priority> tasks(1, Priority::kBackground);
+        tasks.resize(1 + 40, Priority::kHigh);
+
+        ThreadPool::ThreadPoolConfig config = MakeConfig(1, mode);
+        config.starvation_limit = 4;
+        std::vector<int> order = RunOrder(config, tasks);
+        int background_pos = static_cast<int>(std::find(order.begin(), order.end(), 0) - order.begin());
+        CHECK(background_pos < 4);
+
+        // 不防饿死时排在全部kHigh任务之后
+        config.starvation_limit = 0;
+        order = RunOrder(config, tasks);
+        CHECK(order.back() == 0);
+    }
+}
+
+// user-007: 各优先级的等待时间直方图分别统计，桶计数之和等于该优先级执行的任务数
+void TestWaitTimeHistogram() {
+    using Priority = ThreadPool::TaskPriority;
+    ThreadPool::ThreadPoolConfig config = MakeConfig(2);
+    config.is_record_wait_time = true;
+    ThreadPool pool(config);
+    CHECK(pool.Start());
+    const int kTaskNum[ThreadPool::kPriorityNum] = {50, 300, 20};
+    std::atomic<int> count{0};
+    for (int lane = 0; lane < ThreadPool::kPriorityNum; ++lane) {
+        for (int i = 0; i < kTaskNum[lane]; ++i) {
+            CHECK(pool.Post(static_cast<Priority>(lane), [&count] {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+                ++count;
+            }));
+        }
+    }
+    CHECK(WaitUntil([&count] { return count.load() == 370; }, std::chrono::seconds(10)));
+
+    for (int lane = 0; lane < ThreadPool::kPriorityNum; ++lane) {
+        ThreadPool::WaitTimeHistogram histogram = pool.GetWaitTimeHistogram(static_cast<Priority>(lane));
+        uint64_t sum = 0;
+        for (uint64_t bucket : histogram.counts) {
+            sum += bucket;
+        }
+        CHECK(sum == (uint64_t)kTaskNum[lane]);
+        CHECK(histogram.total == sum);
+        CHECK(histogram.Percentile(0.5) <= histogram.Percentile(0.99));
+        CHECK(histogram.Percentile(0.99) >= 1);
+    }
+
+    pool.ResetWaitTimeHistogram();
+    CHECK(pool.GetWaitTimeHistogram(Priority::kNormal).total == 0);
+    CHECK(pool.GetWaitTimeHistogram(Priority::kNormal).Percentile(0.99) == 0);
+
+    // 未开启is_record_wait_time时不统计
+    ThreadPool quiet_pool(MakeConfig(1));
+    CHECK(quiet_pool.Start());
+    auto future = quiet_pool.Submit([] { return 1; });
+    CHECK(future.Get() == 1);
+    CHECK(quiet_pool.GetWaitTimeHistogram(Priority::kNormal).total == 0);
+}
+
+// user-003: Submit无返回值的任务，Get不能读取未赋值的optional
+void TestSubmitVoid() {
+    ThreadPool pool(MakeConfig(2));
+    CHECK(pool.Start());
+    std::atomic<int> count{0};
+    auto future = pool.Submit([&count] { ++count; });
+    CHECK(future.Valid());
+    future.Get();
+    CHECK(count.load() == 1);
+    CHECK(!future.Valid());
+
+    auto error_future = pool.Submit([] { throw std::runtime_error("void task"); });
+    bool is_thrown = false;
+    try {
+        error_future.Get();
+    } catch (const std::runtime_error &) {
+        is_thrown = true;
+    }
+    CHECK(is_thrown);
+}
+
+// user-003: kReject返回的无效TaskFuture，Wait/WaitFor直接返回，Get抛出future_error
+void TestRejectedFuture() {
+    ThreadPool::ThreadPoolConfig config{1, 1, 1, std::chrono::seconds(5)};
+    config.overflow_policy = ThreadPool::OverflowPolicy::kReject;
+    ThreadPool pool(config);
+    CHECK(pool.Start());
+
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::atomic<bool> is_running{false};
+    CHECK(pool.Post([released, &is_running] {
+        is_running = true;
+        released.wait();
+    }));
+    while (!is_running.load()) {
+        std::this_thread::yield();
+    }
+
+    std::vector<util::TaskFuture<int>> futures;
+    for (int i = 0; i < 4; ++i) {
+        futures.push_back(pool.Submit([i] { return i; }));
+    }
+    int invalid_num = 0;
+    for (auto &future : futures) {
+        if (future.Valid()) {
+            continue;
+        }
+        ++invalid_num;
+        future.Wait();
+        CHECK(!future.WaitFor(std::chrono::milliseconds(1)));
+        CHECK(!future.IsReady());
+        bool is_thrown = false;
+        try {
+            future.Get();
+        } catch (const std::future_error &e) {
+            is_thrown = e.code() == std::future_errc::no_state;
+        }
+        CHECK(is_thrown);
+    }
+    CHECK(invalid_num >= 3);
+    release.set_value();
+}
+
+// user-003: 队列稳定后，可调用对象不超过kInlineSize时Post不分配内存
+void TestPostWithoutAllocation() {
+    for (auto mode : {ThreadPool::SchedulerMode::kGlobalQueue, ThreadPool::SchedulerMode::kWorkStealing}) {
+        ThreadPool pool(MakeConfig(2, mode));
+        CHECK(pool.Start());
+        std::atomic<int> count{0};
+        auto post_and_wait = [&pool, &count](int n) {
+            int target = count.load() + n;
+            for (int i = 0; i < n; ++i) {
+                CHECK(pool.Post([&count] { ++count; }));
+            }
+            while (count.load() != target) {
+                std::this_thread::yield();
+            }
+        };
+        // 预热，让任务队列扩容到稳定大小
+        post_and_wait(2000);
+
+        g_alloc_num.store(0);
+        g_is_count_alloc.store(true);
+        post_and_wait(1000);
+        g_is_count_alloc.store(false);
+        CHECK(g_alloc_num.load() == 0);
+    }
+}
+
+void TestParallelForAndReduce() {
+    ThreadPool pool(MakeConfig(4));
+    CHECK(pool.Start());
+    std::vector<int> values(100000, 0);
+    pool.ParallelFor(0, (int)values.size(), 0, [&values](int i) { values[i] = i; });
+    for (int i = 0; i < (int)values.size(); ++i) {
+        CHECK(values[i] == i);
+    }
+    int64_t sum = pool.ParallelReduce(0, (int)values.size(), 0, int64_t(0),
+                                      [&values](int first, int last) {
+                                          return std::accumulate(values.begin() + first, values.begin() + last, int64_t(0));
+                                      },
+                                      [](int64_t a, int64_t b) { return a + b; });
+    CHECK(sum == int64_t(values.size()) * (int64_t(values.size()) - 1) / 2);
+}
+
+void TestTaskGraphOrder() {
+    ThreadPool pool(MakeConfig(4));
+    CHECK(pool.Start());
+    std::atomic<int> step{0};
+    int a_step = -1, b_step = -1, c_step = -1;
+    TaskGraph graph(pool);
+    auto a = graph.AddNode([&] { a_step = step++; });
+    auto b = graph.AddNode([&] { b_step = step++; });
+    auto c = graph.AddNode([&] { c_step = step++; });
+    graph.Precede(a, b);
+    graph.Precede(b, c);
+    CHECK(graph.Run());
+    graph.Wait();
+    CHECK(a_step == 0 && b_step == 1 && c_step == 2);
+
+    TaskGraph cyclic(pool);
+    auto x = cyclic.AddNode([] {});
+    auto y = cyclic.AddNode([] {});
+    cyclic.Precede(x, y);
+    cyclic.Precede(y, x);
+    CHECK(!cyclic.Run());
+}
+
+// user-006: Wait返回后立即析构TaskGraph，工作线程不能再访问图的mutex_/cv_
+// 用-DUTIL_TEST_SANITIZER=address或thread运行时能发现释放后使用
+void TestTaskGraphDestroyAfterWait() {
+    ThreadPool pool(MakeConfig(4));
+    CHECK(pool.Start());
+    std::atomic<int> count{0};
+    for (int round = 0; round < 2000; ++round) {
+        auto graph = std::make_unique<TaskGraph>(pool);
+        auto root = graph->AddNode([&count] { ++count; });
+        for (int i = 0; i < 4; ++i) {
+            auto node = graph->AddNode([&count] { ++count; });
+            graph->Precede(root, node);
+        }
+        CHECK(graph->Run());
+        if (round % 2 == 0) {
+            graph->Wait();
+        }
+        // 奇数轮直接析构，由析构函数等待
+        graph.reset();
+    }
+    CHECK(count.load() == 2000 * 5);
+}
+
+}  // namespace
+
+int main() {
+    RUN_TEST(TestPostAndSubmit);
+    RUN_TEST(TestSubmitException);
+    RUN_TEST(TestWorkStealingExternalFifo);
+    RUN_TEST(TestElasticThreads);
+    RUN_TEST(TestOverflowBlock);
+    RUN_TEST(TestOverflowBlockFromWorker);
+    RUN_TEST(TestOverflowCallerRuns);
+    RUN_TEST(TestOverflowReject);
+    RUN_TEST(TestPriorityOrder);
+    RUN_TEST(TestPriorityStarvationLimit);
+    RUN_TEST(TestWaitTimeHistogram);
+    RUN_TEST(TestSubmitVoid);
+    RUN_TEST(TestRejectedFuture);
+    RUN_TEST(TestPostWithoutAllocation);
+    RUN_TEST(TestParallelForAndReduce);
+    RUN_TEST(TestTaskGraphOrder);
+    RUN_TEST(TestTaskGraphDestroyAfterWait);
+    return 0;
+}